@@ -5,174 +5,4851 @@
 #include <memory>    // For using smart pointers (std::unique_ptr)
 #include <limits>    // For robust input handling
 #include <cmath>
+#include <cstdio>
+#include <ctime>     // For transaction timestamps
+#include <queue>     // For bounded heaps in top-K queries
+#include <unordered_map>
+#include <algorithm>
+#include <utility>
+#include <map>
+#include <fstream>   // For saving and loading snapshots
+#include <sstream>
+#include <cstdint>
+#include <array>
+#include <iterator>
+#include <thread>    // For parallel index rebuilds
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <numeric>
+#include <filesystem>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define FINANCE_HAVE_MMAP 1
+#define FINANCE_HAVE_FSYNC 1
+#endif
+
+#if __cplusplus >= 202002L && __has_include(<coroutine>) && defined(FINANCE_HAVE_FSYNC)
+#include <coroutine>
+#include <csignal>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#define FINANCE_HAVE_COROUTINES 1
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define FINANCE_HAVE_IO_URING 1
+#endif
+
+// Span tracing is compiled in only with -DFINANCE_TRACING; otherwise
+// TRACE_SPAN expands to nothing
+#ifdef FINANCE_TRACING
+#define FINANCE_TRACE_CONCAT_(a, b) a##b
+#define FINANCE_TRACE_CONCAT(a, b) FINANCE_TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(name) ::Finance::TraceSpan FINANCE_TRACE_CONCAT(traceSpan, __LINE__)(name)
+#else
+#define TRACE_SPAN(name) ((void)0)
+#endif
 
 // Use a namespace to keep the code organized
 namespace Finance {
 
-// A base class for all financial transactions
-class Transaction {
-protected:
-    double amount;
-    std::string description;
+// Calendar helpers. Timestamps are UTC std::time_t values; reports bucket them
+// by day number (days since 1970-01-01) and month number (year * 12 + month).
+inline long daysFromCivil(int y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    const long era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<long>(doe) - 719468;
+}
+
+inline void civilFromDays(long z, int& y, unsigned& m, unsigned& d) {
+    z += 719468;
+    const long era = (z >= 0 ? z : z - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(z - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp < 10 ? mp + 3 : mp - 9;
+    y = static_cast<int>(yoe) + static_cast<int>(era) * 400 + (m <= 2);
+}
+
+inline long dayIndex(std::time_t t) {
+    long secs = static_cast<long>(t);
+    return secs >= 0 ? secs / 86400 : -((-secs + 86399) / 86400);
+}
+
+inline int monthIndex(std::time_t t) {
+    int y; unsigned m, d;
+    civilFromDays(dayIndex(t), y, m, d);
+    return y * 12 + static_cast<int>(m) - 1;
+}
+
+inline std::string formatDate(std::time_t t) {
+    int y; unsigned m, d;
+    civilFromDays(dayIndex(t), y, m, d);
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%04d-%02u-%02u", y, m, d);
+    return buf;
+}
+
+inline unsigned daysInMonth(int y, unsigned m) {
+    static const unsigned DAYS_IN_MONTH[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    bool leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+    return DAYS_IN_MONTH[m - 1] + (m == 2 && leap ? 1 : 0);
+}
+
+// Same time of day, `months` calendar months later (day clamped to month end)
+inline std::time_t addMonths(std::time_t t, int months) {
+    long day = dayIndex(t);
+    long secondsIntoDay = static_cast<long>(t) - day * 86400L;
+    int y; unsigned m, d;
+    civilFromDays(day, y, m, d);
+    int total = y * 12 + static_cast<int>(m) - 1 + months;
+    int newYear = total >= 0 ? total / 12 : (total - 11) / 12;
+    unsigned newMonth = static_cast<unsigned>(total - newYear * 12) + 1;
+    unsigned lastDay = daysInMonth(newYear, newMonth);
+    return static_cast<std::time_t>(daysFromCivil(newYear, newMonth, std::min(d, lastDay)) * 86400L + secondsIntoDay);
+}
+
+// Splits "YYYY-MM-DD" into its fields without checking them; trailing text is rejected
+inline bool scanDate(const std::string& text, int& y, unsigned& m, unsigned& d) {
+    int used = 0;
+    return std::sscanf(text.c_str(), "%d-%u-%u%n", &y, &m, &d, &used) == 3 && static_cast<size_t>(used) == text.size();
+}
+
+// Whether the day exists, e.g. not 2026-02-31
+inline bool isCalendarDate(int y, unsigned m, unsigned d) {
+    return m >= 1 && m <= 12 && d >= 1 && d <= daysInMonth(y, m);
+}
+
+// Parses "YYYY-MM-DD" into a timestamp at midnight UTC
+inline bool parseDate(const std::string& text, std::time_t& out) {
+    int y = 0; unsigned m = 0, d = 0;
+    if (!scanDate(text, y, m, d) || !isCalendarDate(y, m, d)) return false;
+    out = static_cast<std::time_t>(daysFromCivil(y, m, d) * 86400L);
+    return true;
+}
+
+// Transaction kinds, usable as small integer indexes
+enum class TransactionKind { Income = 0, Expenditure = 1 };
+constexpr size_t TRANSACTION_KIND_COUNT = 2;
+
+// A base class for all financial transactions
+class Transaction {
+protected:
+    double amount;
+    std::string description;
+    std::string category;
+    std::time_t timestamp;
+
+public:
+    // Use explicit to prevent accidental type conversions
+    explicit Transaction(double amt, std::string des, std::string cat, std::time_t when) 
+        : amount(amt), description(std::move(des)), category(std::move(cat)), timestamp(when) {}
+
+    // Virtual destructor is crucial for base classes with virtual functions
+    virtual ~Transaction() = default;
+
+    // A pure virtual function to get the type of transaction
+    virtual const char* getType() const = 0;
+    virtual TransactionKind getKind() const = 0;
+
+    // A single display function, now const-correct
+    void display(std::ostream& out = std::cout) const {
+        out << std::left << std::setw(15) << getType()
+            << std::right << std::setw(10) << amount
+            << "    " << std::left << std::setw(12) << formatDate(timestamp)
+            << std::setw(15) << category << description << std::endl;
+    }
+
+    // One tab-separated snapshot line: kind, amount, timestamp, category, description
+    void write(std::ostream& out) const {
+        out << getType() << '\t' << std::setprecision(17) << amount << '\t'
+            << static_cast<long long>(timestamp) << '\t' << category << '\t' << description << '\n';
+    }
+
+    double getAmount() const { return amount; }
+    const std::string& getDescription() const { return description; }
+    const std::string& getCategory() const { return category; }
+    std::time_t getTimestamp() const { return timestamp; }
+};
+
+class Income : public Transaction {
+public:
+    explicit Income(double amt, const std::string& des, const std::string& cat = "General",
+                    std::time_t when = std::time(nullptr))
+        : Transaction(amt, des, cat, when) {}
+    const char* getType() const override { return "Income"; }
+    TransactionKind getKind() const override { return TransactionKind::Income; }
+};
+
+class Expenditure : public Transaction {
+public:
+    explicit Expenditure(double amt, const std::string& des, const std::string& cat = "General",
+                         std::time_t when = std::time(nullptr))
+        : Transaction(amt, des, cat, when) {}
+    const char* getType() const override { return "Expenditure"; }
+    TransactionKind getKind() const override { return TransactionKind::Expenditure; }
+};
+
+// Parses one line written by Transaction::write; null when the line is malformed
+inline std::unique_ptr<Transaction> parseTransaction(const std::string& line) {
+    std::istringstream fields(line);
+    std::string kind, amountText, timeText, category, description;
+    if (!std::getline(fields, kind, '\t') || !std::getline(fields, amountText, '\t')
+        || !std::getline(fields, timeText, '\t') || !std::getline(fields, category, '\t')) {
+        return nullptr;
+    }
+    std::getline(fields, description);
+    double amount = std::strtod(amountText.c_str(), nullptr);
+    std::time_t when = static_cast<std::time_t>(std::strtoll(timeText.c_str(), nullptr, 10));
+    if (kind == "Income") return std::make_unique<Income>(amount, description, category, when);
+    if (kind == "Expenditure") return std::make_unique<Expenditure>(amount, description, category, when);
+    return nullptr;
+}
+
+// Keeps the K largest expenditures seen so far, sorted by amount (largest first).
+// Updated on every insert so dashboards can read the answer in O(K).
+class TopKTracker {
+private:
+    size_t capacity;
+    std::vector<const Transaction*> items;
+
+public:
+    explicit TopKTracker(size_t k) : capacity(k) {}
+
+    void offer(const Transaction* t) {
+        if (capacity == 0) return;
+        if (items.size() == capacity && t->getAmount() <= items.back()->getAmount()) return;
+        auto pos = std::upper_bound(items.begin(), items.end(), t,
+            [](const Transaction* a, const Transaction* b) { return a->getAmount() > b->getAmount(); });
+        items.insert(pos, t);
+        if (items.size() > capacity) items.pop_back();
+    }
+
+    size_t getCapacity() const { return capacity; }
+    const std::vector<const Transaction*>& getItems() const { return items; }
+};
+
+// A mergeable KLL quantile sketch. Items live in levels of compactors; an item at
+// level h stands for 2^h original values. Memory stays around O(K) regardless of
+// how many values are added, and rank error is roughly 1.7 / K.
+class QuantileSketch {
+private:
+    static constexpr size_t K = 200;
+    std::vector<std::vector<double>> levels{1};
+    uint64_t count = 0;
+    double minValue = 0.0;
+    double maxValue = 0.0;
+    uint64_t rngState = 0x9E3779B97F4A7C15ULL;  // Deterministic compaction offsets
+
+    size_t levelCapacity(size_t level) const {
+        size_t depth = levels.size() - 1 - level;
+        return std::max<size_t>(2, static_cast<size_t>(K * std::pow(2.0 / 3.0, static_cast<double>(depth))));
+    }
+
+    bool nextCoinFlip() {
+        rngState ^= rngState << 13;
+        rngState ^= rngState >> 7;
+        rngState ^= rngState << 17;
+        return rngState & 1;
+    }
+
+    void compress() {
+        for (size_t h = 0; h < levels.size(); ++h) {
+            if (levels[h].size() < levelCapacity(h)) continue;
+            if (h + 1 == levels.size()) levels.emplace_back();
+            auto& level = levels[h];
+            std::sort(level.begin(), level.end());
+            // An odd item out stays behind so weights remain exact
+            double leftover = 0.0;
+            bool hasLeftover = level.size() % 2 == 1;
+            if (hasLeftover) {
+                leftover = level.back();
+                level.pop_back();
+            }
+            size_t offset = nextCoinFlip() ? 1 : 0;
+            for (size_t i = offset; i < level.size(); i += 2) {
+                levels[h + 1].push_back(level[i]);
+            }
+            level.clear();
+            if (hasLeftover) level.push_back(leftover);
+        }
+    }
+
+public:
+    void add(double value) {
+        if (count == 0 || value < minValue) minValue = value;
+        if (count == 0 || value > maxValue) maxValue = value;
+        ++count;
+        levels[0].push_back(value);
+        if (levels[0].size() >= levelCapacity(0)) compress();
+    }
+
+    // Folds another sketch (e.g. from a different shard) into this one
+    void merge(const QuantileSketch& other) {
+        if (other.count == 0) return;
+        if (count == 0 || other.minValue < minValue) minValue = other.minValue;
+        if (count == 0 || other.maxValue > maxValue) maxValue = other.maxValue;
+        count += other.count;
+        if (levels.size() < other.levels.size()) levels.resize(other.levels.size());
+        for (size_t h = 0; h < other.levels.size(); ++h) {
+            levels[h].insert(levels[h].end(), other.levels[h].begin(), other.levels[h].end());
+        }
+        compress();
+    }
+
+    // Approximate q-quantile (0 <= q <= 1); NaN when the sketch is empty
+    double quantile(double q) const {
+        if (count == 0) return std::numeric_limits<double>::quiet_NaN();
+        if (q <= 0.0) return minValue;
+        if (q >= 1.0) return maxValue;
+
+        std::vector<std::pair<double, uint64_t>> weighted;
+        for (size_t h = 0; h < levels.size(); ++h) {
+            for (double v : levels[h]) weighted.emplace_back(v, uint64_t{1} << h);
+        }
+        std::sort(weighted.begin(), weighted.end());
+        uint64_t total = 0;
+        for (const auto& w : weighted) total += w.second;
+
+        double target = q * static_cast<double>(total);
+        uint64_t cumulative = 0;
+        for (const auto& w : weighted) {
+            cumulative += w.second;
+            if (static_cast<double>(cumulative) >= target) return w.first;
+        }
+        return maxValue;
+    }
+
+    uint64_t getCount() const { return count; }
+
+    // Single-line text form used by snapshots
+    void write(std::ostream& out) const {
+        out << count << ' ' << std::setprecision(17) << minValue << ' ' << maxValue << ' '
+            << rngState << ' ' << levels.size();
+        for (const auto& level : levels) {
+            out << ' ' << level.size();
+            for (double v : level) out << ' ' << v;
+        }
+    }
+
+    bool read(std::istream& in) {
+        size_t numLevels = 0;
+        if (!(in >> count >> minValue >> maxValue >> rngState >> numLevels) || numLevels == 0) return false;
+        levels.assign(numLevels, {});
+        for (auto& level : levels) {
+            size_t size = 0;
+            if (!(in >> size)) return false;
+            level.resize(size);
+            for (double& v : level) {
+                if (!(in >> v)) return false;
+            }
+        }
+        return true;
+    }
+};
+
+
+// Log-linear latency histogram in the style of HdrHistogram. Values below 32 ns
+// are counted exactly; above that, each power of two is split into 32 equal
+// buckets, so any value is reported within about 3% using a fixed 1312
+// counters (up to 2^45 ns, about 9.8 hours). One thread records; others may
+// read while it does, and shards add up with mergeInto().
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 5;
+    static constexpr uint64_t SUB_BUCKETS = uint64_t{1} << SUB_BUCKET_BITS;
+    static constexpr uint64_t MAX_VALUE = (uint64_t{1} << 45) - 1;
+    static constexpr size_t BUCKETS = 41 * SUB_BUCKETS;
+
+    // Plain merged counts, for computing percentiles
+    struct Counts {
+        std::array<uint64_t, BUCKETS> buckets{};
+        uint64_t count = 0;
+        uint64_t max = 0;
+
+        // Nanoseconds at quantile q, as the midpoint of the bucket it falls in
+        double percentile(double q) const {
+            if (count == 0) return 0.0;
+            uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * static_cast<double>(count))));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < BUCKETS; ++i) {
+                seen += buckets[i];
+                if (seen >= rank) {
+                    uint64_t low = lowestIn(i), high = lowestIn(i + 1) - 1;
+                    return std::min(static_cast<double>(max), (static_cast<double>(low) + static_cast<double>(high)) / 2.0);
+                }
+            }
+            return static_cast<double>(max);
+        }
+    };
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets{};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> max{0};
+
+    static int floorLog2(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+        return 63 - __builtin_clzll(value);
+#else
+        int log = 0;
+        while (value >>= 1) ++log;
+        return log;
+#endif
+    }
+
+    static size_t bucketOf(uint64_t value) {
+        if (value < SUB_BUCKETS) return static_cast<size_t>(value);
+        int shift = floorLog2(value) - SUB_BUCKET_BITS;
+        return static_cast<size_t>((shift + 1) * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS));
+    }
+
+    static uint64_t lowestIn(size_t bucket) {
+        if (bucket < SUB_BUCKETS) return bucket;
+        uint64_t shift = bucket / SUB_BUCKETS - 1;
+        return (bucket % SUB_BUCKETS + SUB_BUCKETS) << shift;
+    }
+
+    // Only the owning thread writes, so a relaxed load and store is enough
+    static void bump(std::atomic<uint64_t>& counter, uint64_t by = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+
+public:
+    void record(uint64_t nanos) {
+        nanos = std::min(nanos, MAX_VALUE);
+        bump(buckets[bucketOf(nanos)]);
+        bump(count);
+        if (nanos > max.load(std::memory_order_relaxed)) max.store(nanos, std::memory_order_relaxed);
+    }
+
+    void mergeInto(Counts& merged) const {
+        for (size_t i = 0; i < BUCKETS; ++i) merged.buckets[i] += buckets[i].load(std::memory_order_relaxed);
+        merged.count += count.load(std::memory_order_relaxed);
+        merged.max = std::max(merged.max, max.load(std::memory_order_relaxed));
+    }
+
+    Counts counts() const {
+        Counts result;
+        mergeInto(result);
+        return result;
+    }
+};
+
+// Public operations whose latency is tracked
+enum class Operation {
+    AddTransaction, AddInvestment, RecordIncome, RecordExpenditure, ImportCsv, TransactionHistory,
+    InvestmentPortfolio, InvestmentProjections, RunQuery, SaveData, LoadData, ServerRequest,
+    Count  // Not an operation; keep last
+};
+constexpr size_t OPERATION_COUNT = static_cast<size_t>(Operation::Count);
+
+inline const char* operationName(Operation op) {
+    static constexpr const char* NAMES[] = {
+        "addTransaction", "addInvestment", "recordIncome", "recordExpenditure", "importCsv", "transactionHistory",
+        "investmentPortfolio", "investmentProjections", "runQuery", "saveData", "loadData", "serverRequest"
+    };
+    static_assert(sizeof(NAMES) / sizeof(NAMES[0]) == OPERATION_COUNT, "every Operation needs a name");
+    return NAMES[static_cast<size_t>(op)];
+}
+
+// Each thread records into its own set of histograms, so recording never
+// contends; collect() adds up every thread's set when someone asks
+class LatencyRegistry {
+private:
+    using Shard = std::array<LatencyHistogram, OPERATION_COUNT>;
+    std::mutex lock;
+    std::vector<std::shared_ptr<Shard>> shards;  // Outlive their threads so no samples are lost
+
+    std::shared_ptr<Shard> enroll() {
+        auto shard = std::make_shared<Shard>();
+        std::lock_guard<std::mutex> guard(lock);
+        shards.push_back(shard);
+        return shard;
+    }
+
+public:
+    static LatencyRegistry& shared() {
+        static LatencyRegistry registry;
+        return registry;
+    }
+
+    static void record(Operation op, uint64_t nanos) {
+        thread_local std::shared_ptr<Shard> local = shared().enroll();
+        (*local)[static_cast<size_t>(op)].record(nanos);
+    }
+
+    std::vector<LatencyHistogram::Counts> collect() {
+        std::vector<LatencyHistogram::Counts> merged(OPERATION_COUNT);
+        std::lock_guard<std::mutex> guard(lock);
+        for (const auto& shard : shards) {
+            for (size_t op = 0; op < OPERATION_COUNT; ++op) (*shard)[op].mergeInto(merged[op]);
+        }
+        return merged;
+    }
+};
+
+#ifdef FINANCE_TRACING
+// One thread's most recent spans. Only the owning thread writes; fields are
+// relaxed atomics so a concurrent dump is race-free, though a slot being
+// overwritten while it is read may come out mixed.
+class TraceBuffer {
+public:
+    static constexpr size_t CAPACITY = 1 << 13;
+
+    struct Event {
+        std::atomic<const char*> name{nullptr};
+        std::atomic<uint64_t> start{0};     // Nanoseconds since the recorder started
+        std::atomic<uint64_t> duration{0};
+    };
+
+    std::array<Event, CAPACITY> events;
+    std::atomic<uint64_t> written{0};
+    const uint32_t threadId;
+
+    explicit TraceBuffer(uint32_t id) : threadId(id) {}
+
+    void record(const char* name, uint64_t start, uint64_t duration) {
+        uint64_t next = written.load(std::memory_order_relaxed);
+        Event& event = events[next % CAPACITY];
+        event.name.store(name, std::memory_order_relaxed);
+        event.start.store(start, std::memory_order_relaxed);
+        event.duration.store(duration, std::memory_order_relaxed);
+        written.store(next + 1, std::memory_order_release);
+    }
+};
+
+// Collects every thread's trace buffer and writes them as Chrome trace-event
+// JSON (load the file in chrome://tracing or Perfetto). A thread's buffer is
+// handed back when it exits and lent to the next new thread, so short-lived
+// threads (e.g. import parsers) reuse a fixed set instead of adding one each.
+// A reused buffer keeps its thread id, so its spans share one trace row.
+class TraceRecorder {
+private:
+    std::mutex lock;
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+    std::vector<TraceBuffer*> idle;  // Buffers whose threads have exited
+    const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+
+    TraceBuffer* enroll() {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!idle.empty()) {
+            TraceBuffer* buffer = idle.back();
+            idle.pop_back();
+            return buffer;
+        }
+        buffers.push_back(std::make_unique<TraceBuffer>(static_cast<uint32_t>(buffers.size() + 1)));
+        return buffers.back().get();
+    }
+
+    void release(TraceBuffer* buffer) {
+        std::lock_guard<std::mutex> guard(lock);
+        idle.push_back(buffer);
+    }
+
+    // Holds the calling thread's buffer for as long as the thread runs
+    struct Lease {
+        TraceBuffer* buffer = shared().enroll();
+        ~Lease() { shared().release(buffer); }
+    };
+
+public:
+    // Never destroyed, so threads still exiting at shutdown can hand their
+    // buffers back
+    static TraceRecorder& shared() {
+        static TraceRecorder* recorder = new TraceRecorder;
+        return *recorder;
+    }
+
+    static TraceBuffer& local() {
+        thread_local Lease lease;
+        return *lease.buffer;
+    }
+
+    uint64_t now() const {
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count());
+    }
+
+    bool writeJson(const std::string& path) {
+        std::ofstream out(path);
+        if (!out) return false;
+        out << "{\"traceEvents\":[";
+        bool first = true;
+        std::lock_guard<std::mutex> guard(lock);
+        for (const auto& buffer : buffers) {
+            uint64_t written = buffer->written.load(std::memory_order_acquire);
+            for (uint64_t i = written > TraceBuffer::CAPACITY ? written - TraceBuffer::CAPACITY : 0; i < written; ++i) {
+                const TraceBuffer::Event& event = buffer->events[i % TraceBuffer::CAPACITY];
+                out << (first ? "\n" : ",\n") << "{\"name\":\"" << event.name.load(std::memory_order_relaxed)
+                    << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId << std::fixed << std::setprecision(3)
+                    << ",\"ts\":" << static_cast<double>(event.start.load(std::memory_order_relaxed)) / 1000.0
+                    << ",\"dur\":" << static_cast<double>(event.duration.load(std::memory_order_relaxed)) / 1000.0 << '}';
+                first = false;
+            }
+        }
+        out << "\n]}\n";
+        return static_cast<bool>(out);
+    }
+};
+
+// Records the enclosing scope as one complete ("X") trace event
+class TraceSpan {
+private:
+    const char* name;
+    uint64_t start;
+
+public:
+    explicit TraceSpan(const char* spanName) : name(spanName), start(TraceRecorder::shared().now()) {}
+    ~TraceSpan() { TraceRecorder::local().record(name, start, TraceRecorder::shared().now() - start); }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+};
+#endif
+
+// Records how long the enclosing scope took in the operation's latency
+// histogram and, in tracing builds, as a span named after the operation
+class OperationScope {
+private:
+    Operation op;
+    std::chrono::steady_clock::time_point started;
+#ifdef FINANCE_TRACING
+    TraceSpan span;
+#endif
+
+public:
+    explicit OperationScope(Operation operation)
+        : op(operation), started(std::chrono::steady_clock::now())
+#ifdef FINANCE_TRACING
+        , span(operationName(operation))
+#endif
+    {}
+    ~OperationScope() {
+        auto elapsed = std::chrono::steady_clock::now() - started;
+        LatencyRegistry::record(op, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+    OperationScope(const OperationScope&) = delete;
+    OperationScope& operator=(const OperationScope&) = delete;
+};
+
+// A Roaring-style compressed bitmap of ledger row numbers. Rows are grouped by
+// their high 16 bits; each group is a sorted array of low bits while sparse and
+// switches to a 65536-bit bitmap once it holds more than 4096 rows.
+class RowBitmap {
+private:
+    static constexpr size_t ARRAY_LIMIT = 4096;
+    static constexpr size_t WORDS = 65536 / 64;
+
+    static int lowestBit(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(word);
+#else
+        int bit = 0;
+        while (!(word & 1)) {
+            word >>= 1;
+            ++bit;
+        }
+        return bit;
+#endif
+    }
+
+    static int bitCount(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_popcountll(word);
+#else
+        int count = 0;
+        for (; word; word &= word - 1) ++count;
+        return count;
+#endif
+    }
+
+    struct Container {
+        uint16_t key = 0;
+        size_t cardinality = 0;
+        std::vector<uint16_t> values;  // Used while sparse
+        std::vector<uint64_t> words;   // Used once dense
+
+        bool isBitmap() const { return !words.empty(); }
+
+        bool contains(uint16_t low) const {
+            if (isBitmap()) return (words[low >> 6] >> (low & 63)) & 1;
+            return std::binary_search(values.begin(), values.end(), low);
+        }
+
+        void toBitmap() {
+            words.assign(WORDS, 0);
+            for (uint16_t v : values) words[v >> 6] |= uint64_t{1} << (v & 63);
+            values.clear();
+            values.shrink_to_fit();
+        }
+
+        // Converts back to an array when sparse; drops nothing if already compact
+        void normalize() {
+            if (isBitmap() && cardinality <= ARRAY_LIMIT) {
+                values.clear();
+                forEach([this](uint16_t v) { values.push_back(v); });
+                words.clear();
+                words.shrink_to_fit();
+            } else if (!isBitmap() && cardinality > ARRAY_LIMIT) {
+                toBitmap();
+            }
+        }
+
+        template<typename Fn>
+        void forEach(Fn fn) const {
+            if (!isBitmap()) {
+                for (uint16_t v : values) fn(v);
+                return;
+            }
+            for (size_t w = 0; w < WORDS; ++w) {
+                uint64_t word = words[w];
+                while (word) {
+                    int bit = lowestBit(word);
+                    fn(static_cast<uint16_t>(w * 64 + static_cast<size_t>(bit)));
+                    word &= word - 1;
+                }
+            }
+        }
+
+        std::vector<uint64_t> asWords() const {
+            if (isBitmap()) return words;
+            std::vector<uint64_t> result(WORDS, 0);
+            for (uint16_t v : values) result[v >> 6] |= uint64_t{1} << (v & 63);
+            return result;
+        }
+    };
+
+    std::vector<Container> containers;  // Sorted by key
+
+    enum class Op { And, Or, AndNot };
+
+    static Container combine(const Container& a, const Container& b, Op op) {
+        Container out;
+        out.key = a.key;
+        if (!a.isBitmap() && !b.isBitmap()) {
+            auto sink = std::back_inserter(out.values);
+            if (op == Op::And) std::set_intersection(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), sink);
+            else if (op == Op::Or) std::set_union(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), sink);
+            else std::set_difference(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), sink);
+            out.cardinality = out.values.size();
+        } else if (op == Op::And && !a.isBitmap()) {
+            for (uint16_t v : a.values) if (b.contains(v)) out.values.push_back(v);
+            out.cardinality = out.values.size();
+        } else if (op == Op::And && !b.isBitmap()) {
+            for (uint16_t v : b.values) if (a.contains(v)) out.values.push_back(v);
+            out.cardinality = out.values.size();
+        } else if (op == Op::AndNot && !a.isBitmap()) {
+            for (uint16_t v : a.values) if (!b.contains(v)) out.values.push_back(v);
+            out.cardinality = out.values.size();
+        } else {
+            out.words = a.asWords();
+            std::vector<uint64_t> other = b.asWords();
+            for (size_t w = 0; w < WORDS; ++w) {
+                if (op == Op::And) out.words[w] &= other[w];
+                else if (op == Op::Or) out.words[w] |= other[w];
+                else out.words[w] &= ~other[w];
+                out.cardinality += static_cast<size_t>(bitCount(out.words[w]));
+            }
+        }
+        out.normalize();
+        return out;
+    }
+
+    static RowBitmap combine(const RowBitmap& a, const RowBitmap& b, Op op) {
+        RowBitmap result;
+        size_t i = 0, j = 0;
+        while (i < a.containers.size() || j < b.containers.size()) {
+            bool hasA = i < a.containers.size(), hasB = j < b.containers.size();
+            if (hasA && (!hasB || a.containers[i].key < b.containers[j].key)) {
+                if (op != Op::And) result.containers.push_back(a.containers[i]);
+                ++i;
+            } else if (hasB && (!hasA || b.containers[j].key < a.containers[i].key)) {
+                if (op == Op::Or) result.containers.push_back(b.containers[j]);
+                ++j;
+            } else {
+                Container c = combine(a.containers[i], b.containers[j], op);
+                if (c.cardinality > 0) result.containers.push_back(std::move(c));
+                ++i;
+                ++j;
+            }
+        }
+        return result;
+    }
+
+public:
+    // Rows are appended in increasing order, so the last container is the hot one
+    void add(uint32_t row) {
+        uint16_t key = static_cast<uint16_t>(row >> 16), low = static_cast<uint16_t>(row & 0xFFFF);
+        auto it = containers.end();
+        if (containers.empty() || containers.back().key < key) {
+            containers.emplace_back();
+            containers.back().key = key;
+            it = containers.end() - 1;
+        } else {
+            it = std::lower_bound(containers.begin(), containers.end(), key,
+                [](const Container& c, uint16_t k) { return c.key < k; });
+            if (it == containers.end() || it->key != key) {
+                it = containers.insert(it, Container{});
+                it->key = key;
+            }
+        }
+        if (it->contains(low)) return;
+        if (it->isBitmap()) {
+            it->words[low >> 6] |= uint64_t{1} << (low & 63);
+        } else {
+            it->values.insert(std::upper_bound(it->values.begin(), it->values.end(), low), low);
+        }
+        ++it->cardinality;
+        it->normalize();
+    }
+
+    bool contains(uint32_t row) const {
+        uint16_t key = static_cast<uint16_t>(row >> 16);
+        auto it = std::lower_bound(containers.begin(), containers.end(), key,
+            [](const Container& c, uint16_t k) { return c.key < k; });
+        return it != containers.end() && it->key == key && it->contains(static_cast<uint16_t>(row & 0xFFFF));
+    }
+
+    size_t cardinality() const {
+        size_t total = 0;
+        for (const auto& c : containers) total += c.cardinality;
+        return total;
+    }
+
+    // Visits rows in increasing order
+    template<typename Fn>
+    void forEach(Fn fn) const {
+        for (const auto& c : containers) {
+            uint32_t high = static_cast<uint32_t>(c.key) << 16;
+            c.forEach([&](uint16_t low) { fn(high | low); });
+        }
+    }
+
+    RowBitmap operator&(const RowBitmap& other) const { return combine(*this, other, Op::And); }
+    RowBitmap operator|(const RowBitmap& other) const { return combine(*this, other, Op::Or); }
+    RowBitmap andNot(const RowBitmap& other) const { return combine(*this, other, Op::AndNot); }
+};
+
+// One pool shared by every parallel path. Each worker owns a task deque: it
+// pushes and pops at the back (most recent, still in cache) while idle workers
+// steal from the front of other deques. Threads outside the pool submit to an
+// extra shared deque, and anyone waiting on tasks runs queued work instead of
+// blocking, so nested parallel calls cannot deadlock.
+class WorkStealingPool {
+private:
+    struct TaskQueue {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    const size_t workerCount;
+    std::vector<std::unique_ptr<TaskQueue>> queues;  // One per worker plus the shared one
+    std::vector<std::thread> workers;
+    std::mutex idleLock;
+    std::condition_variable wake;
+    std::atomic<size_t> queued{0};
+    bool stopping = false;
+
+    static inline thread_local size_t currentQueue = std::numeric_limits<size_t>::max();
+
+    size_t ownQueue() const { return currentQueue < workerCount ? currentQueue : workerCount; }
+
+    bool popTask(std::function<void()>& task) {
+        size_t own = ownQueue();
+        for (size_t i = 0; i < queues.size(); ++i) {
+            TaskQueue& queue = *queues[(own + i) % queues.size()];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            if (queue.tasks.empty()) continue;
+            if (i == 0) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            } else {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    void workerLoop(size_t index) {
+        currentQueue = index;
+        while (true) {
+            if (runOne()) continue;
+            std::unique_lock<std::mutex> guard(idleLock);
+            wake.wait(guard, [this] { return stopping || queued.load(std::memory_order_relaxed) > 0; });
+            if (stopping) return;
+        }
+    }
+
+public:
+    explicit WorkStealingPool(size_t count) : workerCount(count) {
+        for (size_t i = 0; i <= workerCount; ++i) queues.push_back(std::make_unique<TaskQueue>());
+        for (size_t i = 0; i < workerCount; ++i) workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> guard(idleLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // The calling thread helps while it waits, so it counts as one more thread
+    static WorkStealingPool& shared() {
+        static WorkStealingPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+        return pool;
+    }
+
+    size_t threadCount() const { return workerCount + 1; }
+
+    void submit(std::function<void()> task) {
+        TaskQueue& queue = *queues[ownQueue()];
+        {
+            std::lock_guard<std::mutex> guard(queue.lock);
+            queue.tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> guard(idleLock);
+            queued.fetch_add(1, std::memory_order_relaxed);
+        }
+        wake.notify_one();
+    }
+
+    bool runOne() {
+        std::function<void()> task;
+        if (!popTask(task)) return false;
+        task();
+        return true;
+    }
+
+    // Runs queued tasks (from any caller) until `remaining` drops to zero
+    void helpUntilDone(const std::atomic<size_t>& remaining) {
+        while (remaining.load(std::memory_order_acquire) > 0) {
+            if (!runOne()) std::this_thread::yield();
+        }
+    }
+};
+
+// Runs fn(begin, end) over [0, count) in chunks of at least `grain` items.
+// Work is cut into a few chunks per thread so stealing can even out chunks
+// that turn out slower than others; the caller runs the first chunk itself.
+template<typename Fn>
+void parallelFor(size_t count, size_t grain, Fn fn) {
+    WorkStealingPool& pool = WorkStealingPool::shared();
+    size_t target = pool.threadCount() * 4;
+    size_t chunk = std::max({grain, size_t{1}, (count + target - 1) / target});
+    if (count <= chunk) {
+        if (count > 0) fn(size_t{0}, count);
+        return;
+    }
+    std::atomic<size_t> remaining{(count - 1) / chunk};
+    for (size_t begin = chunk; begin < count; begin += chunk) {
+        size_t end = std::min(count, begin + chunk);
+        pool.submit([&fn, &remaining, begin, end] {
+            fn(begin, end);
+            remaining.fetch_sub(1, std::memory_order_release);
+        });
+    }
+    fn(size_t{0}, chunk);
+    pool.helpUntilDone(remaining);
+}
+
+// Maps fixed blocks of `grain` items with map(begin, end) in parallel and
+// folds the block results left to right with combine(accumulated, next).
+// Blocks depend only on position, so the result does not depend on how many
+// threads ran or which thread ran which block.
+template<typename T, typename Map, typename Combine>
+T parallelReduce(size_t count, size_t grain, T identity, Map map, Combine combine) {
+    grain = std::max<size_t>(1, grain);
+    std::vector<T> partials((count + grain - 1) / grain, identity);
+    parallelFor(partials.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t b = begin; b < end; ++b) partials[b] = map(b * grain, std::min(count, (b + 1) * grain));
+    });
+    T result = std::move(identity);
+    for (T& partial : partials) result = combine(std::move(result), partial);
+    return result;
+}
+
+// Floating-point sums whose bits do not depend on thread count or scheduling.
+// Values are cut into fixed-size blocks by position alone; each block is summed
+// sequentially with Neumaier compensation, and the block partials are combined
+// in a fixed pairwise tree. Threads only decide who computes which block.
+class DeterministicSum {
+private:
+    static constexpr size_t BLOCK = 2048;
+
+    static double sumBlock(const double* values, size_t n) {
+        double sum = 0.0, compensation = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            double next = sum + values[i];
+            compensation += std::abs(sum) >= std::abs(values[i]) ? (sum - next) + values[i] : (values[i] - next) + sum;
+            sum = next;
+        }
+        return sum + compensation;
+    }
+
+public:
+    static double sum(const double* values, size_t n) {
+        std::vector<double> partials((n + BLOCK - 1) / BLOCK);
+        parallelFor(partials.size(), 16, [&](size_t begin, size_t end) {
+            for (size_t b = begin; b < end; ++b) {
+                partials[b] = sumBlock(values + b * BLOCK, std::min(BLOCK, n - b * BLOCK));
+            }
+        });
+        while (partials.size() > 1) {
+            size_t half = partials.size() / 2;
+            for (size_t i = 0; i < half; ++i) partials[i] = partials[2 * i] + partials[2 * i + 1];
+            if (partials.size() % 2 == 1) partials[half++] = partials.back();
+            partials.resize(half);
+        }
+        return partials.empty() ? 0.0 : partials[0];
+    }
+
+    static double sum(const std::vector<double>& values) { return sum(values.data(), values.size()); }
+};
+
+// Running count, mean and sum of squared deviations (Welford). Two partial
+// states combine exactly with merge() (Chan et al.), so history can be
+// summarized in parallel chunks.
+struct RunningStats {
+    uint64_t count = 0;
+    double mean = 0.0;
+    double m2 = 0.0;
+
+    void add(double x) {
+        ++count;
+        double delta = x - mean;
+        mean += delta / static_cast<double>(count);
+        m2 += delta * (x - mean);
+    }
+
+    void merge(const RunningStats& other) {
+        if (other.count == 0) return;
+        uint64_t total = count + other.count;
+        double delta = other.mean - mean;
+        mean += delta * static_cast<double>(other.count) / static_cast<double>(total);
+        m2 += other.m2 + delta * delta * static_cast<double>(count) * static_cast<double>(other.count) / static_cast<double>(total);
+        count = total;
+    }
+
+    double stddev() const { return count > 1 ? std::sqrt(m2 / static_cast<double>(count - 1)) : 0.0; }
+};
+
+struct AnomalyScore {
+    double zScore = 0.0;       // Distance from the mean in standard deviations
+    double robustScore = 0.0;  // Distance from the median in IQR-derived deviations
+    double median = 0.0;
+    bool outlier = false;
+};
+
+// Flags expenditures far from what a category usually costs. Each category
+// keeps Welford statistics plus a cached median and IQR taken from its quantile
+// sketch, so scoring a new amount is O(1). An amount is an outlier only when
+// both scores agree, which keeps one skewed statistic from raising alarms.
+class AnomalyDetector {
+private:
+    static constexpr uint64_t MIN_HISTORY = 8;
+    static constexpr double SCORE_LIMIT = 3.5;
+    static constexpr double MIN_SPREAD = 0.05;  // Fraction of the median, for near-constant categories
+    static constexpr size_t BLOCK = 4096;
+
+    struct CategoryModel {
+        RunningStats stats;
+        double median = 0.0;
+        double iqr = 0.0;
+        uint64_t refreshAt = 0;
+    };
+    std::map<std::string, CategoryModel> models;
+
+    // The median and IQR are re-read from the sketch as the category grows by an eighth
+    static void refreshRobust(CategoryModel& model, const QuantileSketch& sketch) {
+        model.median = sketch.quantile(0.5);
+        model.iqr = sketch.quantile(0.75) - sketch.quantile(0.25);
+        model.refreshAt = model.stats.count + std::max<uint64_t>(8, model.stats.count / 8);
+    }
+
+public:
+    void observe(const std::string& category, double amount, const QuantileSketch& sketch) {
+        CategoryModel& model = models[category];
+        model.stats.add(amount);
+        if (model.stats.count >= model.refreshAt) refreshRobust(model, sketch);
+    }
+
+    AnomalyScore score(const std::string& category, double amount) const {
+        AnomalyScore result;
+        auto it = models.find(category);
+        if (it == models.end() || it->second.stats.count < MIN_HISTORY) return result;
+        const CategoryModel& model = it->second;
+        double floor = MIN_SPREAD * std::abs(model.median);
+        result.zScore = (amount - model.stats.mean) / std::max(model.stats.stddev(), floor);
+        result.robustScore = (amount - model.median) / std::max(model.iqr / 1.349, floor);
+        result.median = model.median;
+        result.outlier = std::abs(result.zScore) > SCORE_LIMIT && std::abs(result.robustScore) > SCORE_LIMIT;
+        return result;
+    }
+
+    // Summarizes the expenditures of a ledger in parallel blocks, merged in block order
+    template<typename Ledger>
+    static AnomalyDetector build(const Ledger& transactions, const std::map<std::string, QuantileSketch>& sketches) {
+        using Partial = std::map<std::string, RunningStats>;
+        Partial merged = parallelReduce(transactions.size(), BLOCK, Partial{},
+            [&](size_t begin, size_t end) {
+                Partial partial;
+                for (size_t i = begin; i < end; ++i) {
+                    const Transaction& t = *transactions[i];
+                    if (t.getKind() == TransactionKind::Expenditure) partial[t.getCategory()].add(t.getAmount());
+                }
+                return partial;
+            },
+            [](Partial accumulated, const Partial& next) {
+                for (const auto& entry : next) accumulated[entry.first].merge(entry.second);
+                return accumulated;
+            });
+        AnomalyDetector detector;
+        for (const auto& entry : merged) detector.models[entry.first].stats = entry.second;
+        detector.refreshAll(sketches);
+        return detector;
+    }
+
+    void refreshAll(const std::map<std::string, QuantileSketch>& sketches) {
+        for (auto& entry : models) {
+            auto sketch = sketches.find(entry.first);
+            if (sketch != sketches.end()) refreshRobust(entry.second, sketch->second);
+        }
+    }
+
+    void write(std::ostream& out) const {
+        out << "ANOMALY_MODEL " << models.size() << '\n';
+        for (const auto& entry : models) {
+            const RunningStats& stats = entry.second.stats;
+            out << entry.first << '\t' << stats.count << ' ' << std::setprecision(17) << stats.mean << ' ' << stats.m2 << '\n';
+        }
+    }
+
+    // Reads the body of an ANOMALY_MODEL section of n categories
+    bool read(std::istream& in, size_t n) {
+        std::string line;
+        std::getline(in, line);
+        for (size_t i = 0; i < n; ++i) {
+            std::string category;
+            RunningStats stats;
+            if (!std::getline(in, category, '\t') || !(in >> stats.count >> stats.mean >> stats.m2)) return false;
+            std::getline(in, line);
+            models[category].stats = stats;
+        }
+        return true;
+    }
+};
+
+// Ordered index of (amount, row) pairs kept as sorted runs of roughly doubling
+// size. An insert adds a one-entry run and merges equal-sized neighbours, like a
+// binary counter, so inserts are amortized O(log N) and a range query is one
+// pair of binary searches per run.
+class AmountIndex {
+public:
+    using Entry = std::pair<double, uint32_t>;
+
+private:
+    std::vector<std::vector<Entry>> runs;  // Largest run first
+
+    static std::vector<Entry> mergeRuns(const std::vector<Entry>& a, const std::vector<Entry>& b) {
+        std::vector<Entry> merged;
+        merged.reserve(a.size() + b.size());
+        std::merge(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(merged));
+        return merged;
+    }
+
+public:
+    void insert(double amount, uint32_t row) {
+        runs.push_back({Entry{amount, row}});
+        while (runs.size() >= 2 && runs[runs.size() - 2].size() <= runs.back().size()) {
+            std::vector<Entry> merged = mergeRuns(runs[runs.size() - 2], runs.back());
+            runs.pop_back();
+            runs.back() = std::move(merged);
+        }
+    }
+
+    // Number of entries with lo <= amount <= hi
+    size_t count(double lo, double hi) const {
+        size_t total = 0;
+        for (const auto& run : runs) {
+            auto first = std::lower_bound(run.begin(), run.end(), Entry{lo, 0});
+            auto last = std::upper_bound(run.begin(), run.end(), Entry{hi, std::numeric_limits<uint32_t>::max()});
+            if (first < last) total += static_cast<size_t>(last - first);
+        }
+        return total;
+    }
+
+    // Rows with lo <= amount <= hi, ordered by amount
+    std::vector<Entry> range(double lo, double hi) const {
+        std::vector<Entry> result;
+        for (const auto& run : runs) {
+            auto first = std::lower_bound(run.begin(), run.end(), Entry{lo, 0});
+            auto last = std::upper_bound(run.begin(), run.end(), Entry{hi, std::numeric_limits<uint32_t>::max()});
+            size_t middle = result.size();
+            if (first < last) result.insert(result.end(), first, last);
+            std::inplace_merge(result.begin(), result.begin() + static_cast<std::ptrdiff_t>(middle), result.end());
+        }
+        return result;
+    }
+
+    // Builds a single run from an amount column: fixed-size chunks are sorted
+    // in parallel, then merged pairwise a level at a time
+    static AmountIndex build(const std::vector<double>& amounts) {
+        TRACE_SPAN("AmountIndex::build");
+        const size_t CHUNK_ROWS = 1 << 14;
+        std::vector<std::vector<Entry>> chunks((amounts.size() + CHUNK_ROWS - 1) / CHUNK_ROWS);
+        parallelFor(chunks.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; ++c) {
+                auto& chunk = chunks[c];
+                for (size_t row = c * CHUNK_ROWS; row < std::min(amounts.size(), (c + 1) * CHUNK_ROWS); ++row) {
+                    chunk.emplace_back(amounts[row], static_cast<uint32_t>(row));
+                }
+                std::sort(chunk.begin(), chunk.end());
+            }
+        });
+
+        while (chunks.size() > 1) {
+            std::vector<std::vector<Entry>> next((chunks.size() + 1) / 2);
+            parallelFor(chunks.size() / 2, 1, [&](size_t begin, size_t end) {
+                for (size_t p = begin; p < end; ++p) next[p] = mergeRuns(chunks[2 * p], chunks[2 * p + 1]);
+            });
+            if (chunks.size() % 2 == 1) next.back() = std::move(chunks.back());
+            chunks = std::move(next);
+        }
+
+        AmountIndex index;
+        if (!chunks.empty() && !chunks[0].empty()) index.runs.push_back(std::move(chunks[0]));
+        return index;
+    }
+};
+
+// Count and total of the transactions that fall into one rollup bucket
+struct RollupCell {
+    size_t count = 0;
+    double total = 0.0;
+
+    void add(double amount) {
+        ++count;
+        total += amount;
+    }
+};
+
+// Materialized totals for one calendar month, split by kind and category
+struct MonthlyRollup {
+    RollupCell income;
+    RollupCell expenditure;
+    std::map<std::string, RollupCell> incomeByCategory;
+    std::map<std::string, RollupCell> expenditureByCategory;
+};
+
+// Trailing 7/30/90-day spend kept as a ring buffer of daily buckets. Moving
+// forward one day subtracts the bucket leaving each window, so totals are
+// maintained in O(1) per day instead of rescanning history.
+class RollingWindow {
+public:
+    static constexpr size_t WINDOW_COUNT = 3;
+    static constexpr std::array<int, WINDOW_COUNT> WINDOW_DAYS{{7, 30, 90}};
+
+private:
+    static constexpr long HISTORY_DAYS = 90;
+    std::array<RollupCell, HISTORY_DAYS> buckets{};
+    std::array<RollupCell, WINDOW_COUNT> windowTotals{};
+    long headDay = std::numeric_limits<long>::min();
+
+    RollupCell& bucketFor(long day) {
+        return buckets[static_cast<size_t>(((day % HISTORY_DAYS) + HISTORY_DAYS) % HISTORY_DAYS)];
+    }
+    const RollupCell& bucketFor(long day) const {
+        return buckets[static_cast<size_t>(((day % HISTORY_DAYS) + HISTORY_DAYS) % HISTORY_DAYS)];
+    }
+
+    static void subtract(RollupCell& total, const RollupCell& cell) {
+        total.count -= cell.count;
+        total.total -= cell.total;
+        if (total.count == 0) total.total = 0.0;  // Drop accumulated rounding drift
+    }
+
+    void advanceTo(long day) {
+        if (headDay == std::numeric_limits<long>::min() || day - headDay >= HISTORY_DAYS) {
+            buckets.fill(RollupCell{});
+            windowTotals.fill(RollupCell{});
+            headDay = day;
+            return;
+        }
+        for (long d = headDay + 1; d <= day; ++d) {
+            for (size_t w = 0; w < WINDOW_COUNT; ++w) {
+                subtract(windowTotals[w], bucketFor(d - WINDOW_DAYS[w]));
+            }
+            bucketFor(d) = RollupCell{};
+        }
+        headDay = day;
+    }
+
+public:
+    void add(std::time_t when, double amount) {
+        long day = dayIndex(when);
+        if (day > headDay) advanceTo(day);
+        if (day <= headDay - HISTORY_DAYS) return;  // Too old to affect any window
+        bucketFor(day).add(amount);
+        for (size_t w = 0; w < WINDOW_COUNT; ++w) {
+            if (day > headDay - WINDOW_DAYS[w]) windowTotals[w].add(amount);
+        }
+    }
+
+    // Spend in the trailing window ending on the day containing `now`
+    RollupCell trailing(size_t window, std::time_t now) const {
+        long today = dayIndex(now);
+        if (headDay == std::numeric_limits<long>::min() || today - headDay >= WINDOW_DAYS[window]) return RollupCell{};
+        RollupCell result = windowTotals[window];
+        // Days that slid out of the window since the last recorded spend
+        for (long d = headDay + 1; d <= today; ++d) {
+            subtract(result, bucketFor(d - WINDOW_DAYS[window]));
+        }
+        return result;
+    }
+};
+
+// The checks an expenditure must pass before it is recorded, shared by the
+// menu, server mode, recurring rules and imports. The guard keeps its own
+// balance and copy of the spend windows and updates them as rows are
+// accepted, so it can run ahead of the ledger (as the import validator does).
+class SpendingGuard {
+public:
+    enum class Verdict { Accepted, BelowMinimum, OverLimit, Unusual };
+
+    struct Result {
+        Verdict verdict = Verdict::Accepted;
+        std::string reason;  // Why the expenditure was declined or flagged
+        AnomalyScore score;
+    };
+
+private:
+    double balance;
+    double minimumBalance;
+    std::array<double, RollingWindow::WINDOW_COUNT> limits;
+    RollingWindow spend;
+    const AnomalyDetector& anomalies;
+    std::time_t now;
+
+public:
+    SpendingGuard(double currentBalance, double minimum, const std::array<double, RollingWindow::WINDOW_COUNT>& windowLimits,
+                  const RollingWindow& windows, const AnomalyDetector& model, std::time_t asOf = std::time(nullptr))
+        : balance(currentBalance), minimumBalance(minimum), limits(windowLimits), spend(windows), anomalies(model), now(asOf) {}
+
+    // Declines the expenditure if it would take the balance under the minimum
+    // or push any trailing window (ending now) that it falls in over its limit
+    Result checkLimits(double amount, std::time_t when) const {
+        Result result;
+        std::ostringstream reason;
+        reason << std::fixed << std::setprecision(2);
+        if (balance - amount < minimumBalance) {
+            reason << "balance cannot fall below " << minimumBalance << " INR";
+            result.verdict = Verdict::BelowMinimum;
+        }
+        for (size_t w = 0; result.verdict == Verdict::Accepted && w < limits.size(); ++w) {
+            if (limits[w] <= 0.0 || dayIndex(when) <= dayIndex(now) - RollingWindow::WINDOW_DAYS[w]) continue;
+            double spent = spend.trailing(w, now).total;
+            if (spent + amount > limits[w]) {
+                reason << "spending over the last " << RollingWindow::WINDOW_DAYS[w] << " days would exceed the limit of "
+                       << limits[w] << " INR (already spent " << spent << " INR)";
+                result.verdict = Verdict::OverLimit;
+            }
+        }
+        result.reason = reason.str();
+        return result;
+    }
+
+    // checkLimits, then flags amounts far outside the category's history
+    Result check(double amount, const std::string& category, std::time_t when) const {
+        Result result = checkLimits(amount, when);
+        if (result.verdict != Verdict::Accepted) return result;
+        result.score = anomalies.score(category, amount);
+        if (result.score.outlier) {
+            std::ostringstream reason;
+            reason << std::fixed << std::setprecision(2) << amount << " INR is unusual for " << category << " (typical "
+                   << result.score.median << " INR, " << std::setprecision(1) << result.score.zScore << " std devs)";
+            result.verdict = Verdict::Unusual;
+            result.reason = reason.str();
+        }
+        return result;
+    }
+
+    // Counts a recorded transaction against the balance and windows
+    void accept(const Transaction& t) {
+        if (t.getKind() == TransactionKind::Income) {
+            balance += t.getAmount();
+        } else {
+            balance -= t.getAmount();
+            spend.add(t.getTimestamp(), t.getAmount());
+        }
+    }
+
+    double getBalance() const { return balance; }
+};
+
+class SIP;
+class FD;
+
+// Rate and compounding frequency of each standard instrument
+template<typename Instrument> struct CompoundingTraits;
+
+template<> struct CompoundingTraits<SIP> {
+    static constexpr double ANNUAL_RATE = 0.096;
+    static constexpr int PERIODS_PER_YEAR = 12;
+};
+
+template<> struct CompoundingTraits<FD> {
+    static constexpr double ANNUAL_RATE = 0.071;
+    static constexpr int PERIODS_PER_YEAR = 1;
+};
+
+// base^exp by repeated squaring, usable in constant expressions
+constexpr double constexprPow(double base, int exp) {
+    double result = 1.0;
+    while (exp > 0) {
+        if (exp & 1) result *= base;
+        base *= base;
+        exp >>= 1;
+    }
+    return result;
+}
+
+constexpr bool closeTo(double value, double reference, double relativeTolerance) {
+    double diff = value > reference ? value - reference : reference - value;
+    return diff <= relativeTolerance * (reference > 0 ? reference : -reference);
+}
+
+// Growth factors (1 + r/p)^(p * years) and annuity factors
+// ((growth - 1) / (r/p)) for whole-year tenures, generated at compile time so
+// maturity amounts for standard tenures need no pow() calls at runtime
+template<typename Instrument>
+struct CompoundingTable {
+    using Traits = CompoundingTraits<Instrument>;
+    static constexpr int MAX_YEARS = 50;
+    static constexpr double PERIOD_RATE = Traits::ANNUAL_RATE / Traits::PERIODS_PER_YEAR;
+
+    static constexpr std::array<double, MAX_YEARS + 1> makeGrowth() {
+        std::array<double, MAX_YEARS + 1> table{};
+        for (int years = 0; years <= MAX_YEARS; ++years) {
+            table[years] = constexprPow(1.0 + PERIOD_RATE, years * Traits::PERIODS_PER_YEAR);
+        }
+        return table;
+    }
+
+    static constexpr std::array<double, MAX_YEARS + 1> makeAnnuity() {
+        std::array<double, MAX_YEARS + 1> table = makeGrowth();
+        for (double& factor : table) factor = (factor - 1.0) / PERIOD_RATE;
+        return table;
+    }
+
+    static constexpr std::array<double, MAX_YEARS + 1> growth = makeGrowth();
+    static constexpr std::array<double, MAX_YEARS + 1> annuity = makeAnnuity();
+
+    static constexpr bool covers(int years) { return years >= 0 && years <= MAX_YEARS; }
+};
+
+// Table entries checked against the runtime formula, evaluated offline at high precision
+static_assert(closeTo(CompoundingTable<SIP>::growth[1], 1.1003386937161463347, 1e-13), "SIP growth table drifted");
+static_assert(closeTo(CompoundingTable<SIP>::growth[5], 1.6129909346550375053, 1e-13), "SIP growth table drifted");
+static_assert(closeTo(CompoundingTable<SIP>::growth[30], 17.611305850968413105, 1e-13), "SIP growth table drifted");
+static_assert(closeTo(CompoundingTable<SIP>::annuity[10], 200.21746940991643392, 1e-12), "SIP annuity table drifted");
+static_assert(closeTo(CompoundingTable<SIP>::annuity[30], 2076.4132313710516381, 1e-12), "SIP annuity table drifted");
+static_assert(closeTo(CompoundingTable<FD>::growth[6], 1.5091653486913899210, 1e-13), "FD growth table drifted");
+static_assert(closeTo(CompoundingTable<FD>::growth[30], 7.8286003870563143492, 1e-13), "FD growth table drifted");
+
+// A dated cash flow from the investor's point of view (negative = paid in)
+struct CashFlow {
+    std::time_t when;
+    double amount;
+};
+
+// A base class for all investments
+class Investment {
+protected:
+    double principal;
+    int durationYears;
+    std::time_t startDate;
+
+public:
+    explicit Investment(double amt, int dur, std::time_t start = std::time(nullptr)) 
+        : principal(amt), durationYears(dur), startDate(start) {}
+    
+    virtual ~Investment() = default;
+
+    virtual const char* getType() const = 0;
+    virtual double getMaturityAmount() const = 0;
+
+    // Scheduled contributions and the payout at maturity
+    virtual std::vector<CashFlow> getCashFlows() const = 0;
+
+    // One snapshot line; the first token identifies the instrument
+    virtual void write(std::ostream& out) const = 0;
+
+    virtual void display(std::ostream& out = std::cout) const {
+        out << std::left << std::setw(15) << getType()
+            << std::right << std::setw(10) << principal
+            << std::setw(15) << durationYears << " yrs";
+    }
+
+    double getPrincipal() const { return principal; }
+    int getDurationYears() const { return durationYears; }
+    std::time_t getStartDate() const { return startDate; }
+};
+
+class SIP : public Investment {
+private:
+    double monthlyInvestment;
+    std::string fundCode;  // Fund whose NAV history values this SIP; empty if untracked
+    // AFTER: Using a constant for the interest rate
+    static constexpr double ANNUAL_RATE = CompoundingTraits<SIP>::ANNUAL_RATE;
+
+public:
+    explicit SIP(double principalAmt, int dur, double monthlyAmt, std::time_t start = std::time(nullptr),
+                 std::string fund = "") 
+        : Investment(principalAmt, dur, start), monthlyInvestment(monthlyAmt), fundCode(std::move(fund)) {}
+
+    const char* getType() const override { return "SIP"; }
+
+    void write(std::ostream& out) const override {
+        out << "SIP " << std::setprecision(17) << principal << ' ' << durationYears << ' ' << monthlyInvestment
+            << ' ' << static_cast<long long>(startDate) << ' ' << (fundCode.empty() ? "-" : fundCode) << '\n';
+    }
+
+    const std::string& getFundCode() const { return fundCode; }
+
+    // Principal up front, then an installment at the end of every month
+    std::vector<CashFlow> getCashFlows() const override {
+        int months = durationYears * 12;
+        std::vector<CashFlow> flows;
+        flows.reserve(static_cast<size_t>(std::max(0, months)) + 2);
+        flows.push_back({startDate, -principal});
+        for (int m = 1; m <= months; ++m) flows.push_back({addMonths(startDate, m), -monthlyInvestment});
+        flows.push_back({addMonths(startDate, months), getMaturityAmount()});
+        return flows;
+    }
+
+    double getMonthlyInvestment() const { return monthlyInvestment; }
+    static constexpr double getAnnualRate() { return ANNUAL_RATE; }
+
+    double getMaturityAmount() const override {
+        using Table = CompoundingTable<SIP>;
+        if (Table::covers(durationYears)) {
+            return principal * Table::growth[durationYears] + monthlyInvestment * Table::annuity[durationYears];
+        }
+        double finalAmount = principal * pow(1 + (ANNUAL_RATE / 12), durationYears * 12);
+        // A more standard formula for future value of a series
+        double monthlyContributionFutureValue = monthlyInvestment * ((pow(1 + (ANNUAL_RATE / 12), durationYears * 12) - 1) / (ANNUAL_RATE / 12));
+        return finalAmount + monthlyContributionFutureValue;
+    }
+
+    void display(std::ostream& out = std::cout) const override {
+        Investment::display(out);
+        out << std::setw(25) << " (Monthly: " << monthlyInvestment << ")" << std::endl;
+    }
+};
+
+class FD : public Investment {
+private:
+    // AFTER: Using a constant makes the code cleaner and easier to change
+    static constexpr double ANNUAL_RATE = CompoundingTraits<FD>::ANNUAL_RATE;
+
+public:
+    explicit FD(double amt, int dur, std::time_t start = std::time(nullptr)) : Investment(amt, dur, start) {}
+    const char* getType() const override { return "Fixed Deposit"; }
+
+    void write(std::ostream& out) const override {
+        out << "FD " << std::setprecision(17) << principal << ' ' << durationYears
+            << ' ' << static_cast<long long>(startDate) << '\n';
+    }
+
+    std::vector<CashFlow> getCashFlows() const override {
+        return {{startDate, -principal}, {addMonths(startDate, durationYears * 12), getMaturityAmount()}};
+    }
+    
+    double getMaturityAmount() const override {
+        using Table = CompoundingTable<FD>;
+        if (Table::covers(durationYears)) return principal * Table::growth[durationYears];
+        return principal * pow((1 + ANNUAL_RATE), durationYears);
+    }
+    
+    void display(std::ostream& out = std::cout) const override {
+        Investment::display(out);
+        out << std::endl;
+    }
+};
+
+// One day's net asset value. Series files are arrays of these sorted by day.
+struct NavPoint {
+    int64_t day;  // Days since 1970-01-01
+    double nav;
+};
+
+// A read-only daily NAV series for one fund, memory-mapped where the platform
+// allows so millions of points cost no load time or heap
+class NavSeries {
+private:
+    const NavPoint* points = nullptr;
+    size_t count = 0;
+    void* mapping = nullptr;
+    size_t mappedBytes = 0;
+    std::vector<NavPoint> buffer;  // Used when mmap is unavailable
+
+public:
+    NavSeries() = default;
+    NavSeries(const NavSeries&) = delete;
+    NavSeries& operator=(const NavSeries&) = delete;
+
+    ~NavSeries() {
+#ifdef FINANCE_HAVE_MMAP
+        if (mapping) munmap(mapping, mappedBytes);
+#endif
+    }
+
+    bool open(const std::string& path) {
+#ifdef FINANCE_HAVE_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size <= 0 || info.st_size % sizeof(NavPoint) != 0) {
+            ::close(fd);
+            return false;
+        }
+        mappedBytes = static_cast<size_t>(info.st_size);
+        void* address = mmap(nullptr, mappedBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (address == MAP_FAILED) return false;
+        mapping = address;
+        points = static_cast<const NavPoint*>(address);
+        count = mappedBytes / sizeof(NavPoint);
+        return true;
+#else
+        std::ifstream in(path, std::ios::binary);
+        NavPoint point;
+        while (in.read(reinterpret_cast<char*>(&point), sizeof(point))) buffer.push_back(point);
+        points = buffer.data();
+        count = buffer.size();
+        return count > 0;
+#endif
+    }
+
+    // NAV of the last trading day on or before `day`; falls back to the first
+    // available NAV when `day` precedes the series
+    double navOn(long day) const {
+        const NavPoint* end = points + count;
+        const NavPoint* it = std::upper_bound(points, end, static_cast<int64_t>(day),
+            [](int64_t d, const NavPoint& p) { return d < p.day; });
+        return it == points ? points[0].nav : (it - 1)->nav;
+    }
+
+    size_t size() const { return count; }
+};
+
+// Fund codes name files under the NAV directory, so only letters, digits,
+// '_' and '-' are allowed
+inline bool isValidFundCode(const std::string& fund) {
+    return !fund.empty() && std::all_of(fund.begin(), fund.end(), [](unsigned char c) {
+        return std::isalnum(c) || c == '_' || c == '-';
+    });
+}
+
+// NAV series per fund code, stored as <directory>/<FUND>.nav
+class NavStore {
+private:
+    std::string directory;
+    std::map<std::string, std::unique_ptr<NavSeries>> series;
+
+public:
+    explicit NavStore(std::string dir) : directory(std::move(dir)) {}
+
+    // Opens the fund's series on first use; null if there is none
+    const NavSeries* get(const std::string& fund) {
+        if (!isValidFundCode(fund)) return nullptr;
+        auto it = series.find(fund);
+        if (it == series.end()) {
+            auto loaded = std::make_unique<NavSeries>();
+            if (!loaded->open(directory + "/" + fund + ".nav")) loaded.reset();
+            it = series.emplace(fund, std::move(loaded)).first;
+        }
+        return it->second.get();
+    }
+
+    // Converts "YYYY-MM-DD,nav" lines into the fund's binary series file
+    bool importCsv(const std::string& csvPath, const std::string& fund, std::string& error) {
+        if (!isValidFundCode(fund)) {
+            error = "invalid fund code '" + fund + "'";
+            return false;
+        }
+        std::ifstream in(csvPath);
+        if (!in) {
+            error = "cannot open " + csvPath;
+            return false;
+        }
+        std::vector<NavPoint> points;
+        std::string line;
+        while (std::getline(in, line)) {
+            size_t comma = line.find(',');
+            std::time_t when;
+            if (comma == std::string::npos || !parseDate(line.substr(0, comma), when)) continue;  // Header or junk
+            double nav = std::strtod(line.c_str() + comma + 1, nullptr);
+            if (nav > 0.0) points.push_back({dayIndex(when), nav});
+        }
+        if (points.empty()) {
+            error = "no valid rows in " + csvPath;
+            return false;
+        }
+        std::sort(points.begin(), points.end(), [](const NavPoint& a, const NavPoint& b) { return a.day < b.day; });
+
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        std::ofstream out(directory + "/" + fund + ".nav", std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(points.data()), static_cast<std::streamsize>(points.size() * sizeof(NavPoint)));
+        if (!out) {
+            error = "cannot write series for " + fund;
+            return false;
+        }
+        series.erase(fund);  // Reopen the new file on next use
+        return true;
+    }
+};
+
+// Market value of one SIP from its fund's NAV history
+struct SipValuation {
+    bool valued = false;
+    const char* status = "";
+    int installments = 0;      // Purchases made up to the valuation date
+    double invested = 0.0;
+    double units = 0.0;
+    double currentValue = 0.0;
+};
+
+// Buys units at the NAV of each installment date (principal on the start date,
+// then one installment per month) up to `asOf`, and values them at that day's NAV
+inline SipValuation valueSip(const SIP& sip, const NavSeries& nav, std::time_t asOf) {
+    SipValuation result;
+    long today = dayIndex(asOf);
+    int months = sip.getDurationYears() * 12;
+    for (int m = 0; m <= months; ++m) {
+        std::time_t date = addMonths(sip.getStartDate(), m);
+        if (dayIndex(date) > today) break;
+        double amount = m == 0 ? sip.getPrincipal() : sip.getMonthlyInvestment();
+        result.units += amount / nav.navOn(dayIndex(date));
+        result.invested += amount;
+        if (m > 0) ++result.installments;
+    }
+    result.currentValue = result.units * nav.navOn(today);
+    result.valued = true;
+    result.status = "ok";
+    return result;
+}
+
+// The installments valueSip has bought up to `asOf`, closed by the holding's
+// market value on that day; empty if nothing has been bought yet
+inline std::vector<CashFlow> sipMarketCashFlows(const SIP& sip, const SipValuation& valuation, std::time_t asOf) {
+    std::vector<CashFlow> flows;
+    if (!valuation.valued || valuation.invested <= 0.0) return flows;
+    flows.reserve(static_cast<size_t>(valuation.installments) + 2);
+    flows.push_back({sip.getStartDate(), -sip.getPrincipal()});
+    for (int m = 1; m <= valuation.installments; ++m) {
+        flows.push_back({addMonths(sip.getStartDate(), m), -sip.getMonthlyInvestment()});
+    }
+    flows.push_back({asOf, valuation.currentValue});
+    return flows;
+}
+
+// Axes of a what-if sweep. Every rate is applied to every instrument; an empty
+// monthlyAmounts list keeps each SIP's own installment.
+struct ScenarioGrid {
+    std::vector<double> rates;          // Annual rates, e.g. 0.08 for 8%
+    std::vector<int> durations;         // Years
+    std::vector<double> monthlyAmounts;
+};
+
+// Dense maturity values indexed [rate][duration][monthly amount][investment]
+struct ScenarioTensor {
+    size_t rateCount = 0, durationCount = 0, monthlyCount = 0, investmentCount = 0;
+    std::vector<double> values;
+
+    double at(size_t rate, size_t duration, size_t monthly, size_t investment) const {
+        return values[((rate * durationCount + duration) * monthlyCount + monthly) * investmentCount + investment];
+    }
+};
+
+// Portfolio laid out as plain arrays so the sweep's inner loop is a
+// branch-free multiply-add over investments that the compiler can vectorize
+struct PortfolioColumns {
+    std::vector<double> principal;
+    std::vector<double> monthly;
+    std::vector<double> isSip;  // 1.0 for monthly-compounded SIPs, 0.0 for annual FDs
+};
+
+inline ScenarioTensor sweepScenarios(const PortfolioColumns& portfolio, const ScenarioGrid& grid) {
+    ScenarioTensor tensor;
+    tensor.rateCount = grid.rates.size();
+    tensor.durationCount = grid.durations.size();
+    tensor.monthlyCount = grid.monthlyAmounts.empty() ? 1 : grid.monthlyAmounts.size();
+    tensor.investmentCount = portfolio.principal.size();
+    tensor.values.resize(tensor.rateCount * tensor.durationCount * tensor.monthlyCount * tensor.investmentCount);
+
+    const size_t n = tensor.investmentCount;
+    const double* principal = portfolio.principal.data();
+    const double* ownMonthly = portfolio.monthly.data();
+    const double* isSip = portfolio.isSip.data();
+
+    parallelFor(tensor.rateCount, 8, [&](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; ++r) {
+            const double rate = grid.rates[r], monthlyRate = rate / 12.0;
+            for (size_t d = 0; d < tensor.durationCount; ++d) {
+                const int years = grid.durations[d];
+                // Transcendentals once per (rate, duration), not once per investment
+                const double sipGrowth = std::pow(1.0 + monthlyRate, years * 12);
+                const double annuity = monthlyRate != 0.0 ? (sipGrowth - 1.0) / monthlyRate : years * 12.0;
+                const double fdGrowth = std::pow(1.0 + rate, years);
+                for (size_t m = 0; m < tensor.monthlyCount; ++m) {
+                    double* out = &tensor.values[((r * tensor.durationCount + d) * tensor.monthlyCount + m) * n];
+                    if (grid.monthlyAmounts.empty()) {
+                        for (size_t i = 0; i < n; ++i) {
+                            out[i] = principal[i] * (fdGrowth + isSip[i] * (sipGrowth - fdGrowth))
+                                   + isSip[i] * ownMonthly[i] * annuity;
+                        }
+                    } else {
+                        const double contribution = grid.monthlyAmounts[m] * annuity;
+                        for (size_t i = 0; i < n; ++i) {
+                            out[i] = principal[i] * (fdGrowth + isSip[i] * (sipGrowth - fdGrowth))
+                                   + isSip[i] * contribution;
+                        }
+                    }
+                }
+            }
+        }
+    });
+    return tensor;
+}
+
+// A savings target for a SIP: reach `target` after `years` of monthly
+// installments on top of an up-front principal
+struct SavingsGoal {
+    double target;
+    int years;
+    double principal = 0.0;
+    double annualRate = SIP::getAnnualRate();
+};
+
+// Inverts the SIP maturity formula FV = P * g + M * (g - 1) / i, where
+// i = rate / 12 and g = (1 + i)^(12 * years), for whole batches of goals
+class GoalSolver {
+private:
+    static constexpr int BISECTION_ROUNDS = 60;
+
+public:
+    // Required monthly installment per goal, in closed form. Zero when the
+    // principal alone already reaches the target.
+    static std::vector<double> requiredMonthly(const std::vector<SavingsGoal>& goals) {
+        std::vector<double> monthly(goals.size());
+        for (size_t k = 0; k < goals.size(); ++k) {
+            const SavingsGoal& goal = goals[k];
+            double i = goal.annualRate / 12.0;
+            int months = goal.years * 12;
+            double growth = std::pow(1.0 + i, months);
+            double annuity = i != 0.0 ? (growth - 1.0) / i : static_cast<double>(months);
+            double shortfall = goal.target - goal.principal * growth;
+            monthly[k] = annuity > 0.0 ? std::max(0.0, shortfall / annuity) : std::numeric_limits<double>::quiet_NaN();
+        }
+        return monthly;
+    }
+
+    // Annual rate needed to reach each goal with the given monthly installment.
+    // There is no closed form, so all goals are bisected together in lock-step
+    // over [0%, 100%]; NaN marks goals that are out of reach in that range.
+    static std::vector<double> requiredRate(const std::vector<SavingsGoal>& goals, const std::vector<double>& monthly) {
+        const size_t n = goals.size();
+        std::vector<double> lo(n, 0.0), hi(n, 1.0), result(n);
+        auto maturity = [&](size_t k, double rate) {
+            double i = rate / 12.0;
+            int months = goals[k].years * 12;
+            double growth = std::pow(1.0 + i, months);
+            double annuity = i != 0.0 ? (growth - 1.0) / i : static_cast<double>(months);
+            return goals[k].principal * growth + monthly[k] * annuity;
+        };
+        for (int round = 0; round < BISECTION_ROUNDS; ++round) {
+            for (size_t k = 0; k < n; ++k) {
+                double mid = 0.5 * (lo[k] + hi[k]);
+                if (maturity(k, mid) < goals[k].target) lo[k] = mid;
+                else hi[k] = mid;
+            }
+        }
+        for (size_t k = 0; k < n; ++k) {
+            bool reachable = maturity(k, 1.0) >= goals[k].target;
+            result[k] = reachable ? hi[k] : std::numeric_limits<double>::quiet_NaN();
+        }
+        return result;
+    }
+};
+
+// Annualized internal rate of return for one cash-flow schedule
+struct XirrResult {
+    double rate = std::numeric_limits<double>::quiet_NaN();
+    int iterations = 0;
+    bool converged = false;
+    double residual = 0.0;     // NPV at the returned rate
+    const char* status = "";   // Why the solve stopped
+};
+
+// Solves XIRR (NPV(r) = sum amount / (1 + r)^(days / 365) = 0) for many
+// schedules at once. Each chunk of schedules advances in lock-step: one
+// safeguarded Newton step per schedule per round, falling back to bisection
+// whenever Newton would leave the sign-change bracket. Chunks run in parallel.
+class XirrSolver {
+private:
+    static constexpr int MAX_ITERATIONS = 100;
+    static constexpr double TOLERANCE = 1e-10;
+    static constexpr double MIN_RATE = -0.9999;
+    static constexpr double MAX_RATE = 100.0;
+
+    struct State {
+        double lo, hi, rate;
+        double npvLo;
+    };
+
+    // NPV and its derivative, with times in years from the first flow
+    static void npv(const std::vector<CashFlow>& flows, double rate, double& value, double& derivative) {
+        value = derivative = 0.0;
+        double base = std::log1p(rate);
+        std::time_t t0 = flows.front().when;
+        for (const auto& flow : flows) {
+            double years = static_cast<double>(flow.when - t0) / (365.0 * 86400.0);
+            double discount = std::exp(-years * base);
+            value += flow.amount * discount;
+            derivative -= years * flow.amount * discount / (1.0 + rate);
+        }
+    }
+
+    static void solveChunk(const std::vector<std::vector<CashFlow>>& schedules, std::vector<XirrResult>& results,
+                           size_t begin, size_t end) {
+        std::vector<State> states(end - begin);
+        std::vector<size_t> active;
+        for (size_t i = begin; i < end; ++i) {
+            const auto& flows = schedules[i];
+            XirrResult& result = results[i];
+            bool hasIn = false, hasOut = false;
+            for (const auto& flow : flows) {
+                hasIn = hasIn || flow.amount > 0.0;
+                hasOut = hasOut || flow.amount < 0.0;
+            }
+            if (!hasIn || !hasOut) {
+                result.status = "needs both inflows and outflows";
+                continue;
+            }
+            double fLo, fHi, d;
+            npv(flows, MIN_RATE, fLo, d);
+            npv(flows, MAX_RATE, fHi, d);
+            if ((fLo > 0.0) == (fHi > 0.0)) {
+                result.status = "no sign change in rate range";
+                continue;
+            }
+            states[i - begin] = State{MIN_RATE, MAX_RATE, 0.1, fLo};
+            active.push_back(i);
+        }
+
+        for (int round = 1; round <= MAX_ITERATIONS && !active.empty(); ++round) {
+            size_t kept = 0;
+            for (size_t i : active) {
+                State& st = states[i - begin];
+                XirrResult& result = results[i];
+                double f, df;
+                npv(schedules[i], st.rate, f, df);
+                result.iterations = round;
+                result.residual = f;
+                if (std::abs(f) < TOLERANCE * 1e3 || st.hi - st.lo < TOLERANCE) {
+                    result.rate = st.rate;
+                    result.converged = true;
+                    result.status = "converged";
+                    continue;
+                }
+                // Shrink the bracket around the root
+                if ((f > 0.0) == (st.npvLo > 0.0)) {
+                    st.lo = st.rate;
+                    st.npvLo = f;
+                } else {
+                    st.hi = st.rate;
+                }
+                double next = df != 0.0 ? st.rate - f / df : st.lo - 1.0;
+                if (!(next > st.lo && next < st.hi)) next = 0.5 * (st.lo + st.hi);
+                bool settled = std::abs(next - st.rate) < TOLERANCE * std::max(1.0, std::abs(st.rate));
+                st.rate = next;
+                if (settled) {
+                    result.rate = st.rate;
+                    result.converged = true;
+                    result.status = "converged";
+                    continue;
+                }
+                active[kept++] = i;
+            }
+            active.resize(kept);
+        }
+        for (size_t i : active) {
+            results[i].rate = states[i - begin].rate;
+            results[i].status = "iteration limit reached";
+        }
+    }
+
+public:
+    static std::vector<XirrResult> solveBatch(const std::vector<std::vector<CashFlow>>& schedules) {
+        std::vector<XirrResult> results(schedules.size());
+        const size_t MIN_CHUNK = 256;
+        parallelFor(schedules.size(), MIN_CHUNK, [&](size_t begin, size_t end) {
+            solveChunk(schedules, results, begin, end);
+        });
+        return results;
+    }
+};
+
+inline std::string toLower(std::string text) {
+    for (char& c : text) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return text;
+}
+
+// A parsed ledger query. Syntax (keywords are case-insensitive, values with
+// spaces go in double quotes):
+//   [list|count|sum|avg|min|max] {condition} [order amount|date [asc|desc]] [limit N]
+//   (limit applies to list queries only)
+//   condition: kind=income|expenditure  category=NAME  desc~TEXT
+//              amount<op>NUMBER  date<op>YYYY-MM-DD   (op is =, <, <=, > or >=)
+// Example: sum kind=expenditure category=Food date>=2026-01-01 date<2026-02-01
+struct Query {
+    enum class Aggregate { List, Count, Sum, Avg, Min, Max };
+    enum class OrderBy { None, Amount, Date };
+
+    Aggregate aggregate = Aggregate::List;
+    int kind = -1;  // TransactionKind value, or -1 for any
+    bool hasCategory = false;
+    std::string category;
+    std::string descriptionMatch;  // Lower-case substring, empty for any
+    double minAmount = -std::numeric_limits<double>::infinity();
+    double maxAmount = std::numeric_limits<double>::infinity();
+    std::time_t from = std::numeric_limits<std::time_t>::min();
+    std::time_t to = std::numeric_limits<std::time_t>::max();
+    OrderBy orderBy = OrderBy::None;
+    bool descending = false;
+    size_t limit = 0;  // 0 means no limit
+
+    // True if the transaction satisfies every condition (ignores order/limit)
+    bool matches(const Transaction& t) const {
+        return t.getAmount() >= minAmount && t.getAmount() <= maxAmount
+            && t.getTimestamp() >= from && t.getTimestamp() <= to
+            && (kind < 0 || static_cast<int>(t.getKind()) == kind)
+            && (!hasCategory || t.getCategory() == category)
+            && (descriptionMatch.empty() || toLower(t.getDescription()).find(descriptionMatch) != std::string::npos);
+    }
+
+    // Canonical text form; queries that differ only in spelling or term
+    // order normalize to the same key
+    std::string normalized() const {
+        std::ostringstream key;
+        key << static_cast<int>(aggregate) << '|' << kind << '|' << hasCategory << ':' << category
+            << '|' << descriptionMatch << '|' << std::setprecision(17) << minAmount << '|' << maxAmount
+            << '|' << static_cast<long long>(from) << '|' << static_cast<long long>(to)
+            << '|' << static_cast<int>(orderBy) << descending << '|' << limit;
+        return key.str();
+    }
+};
+
+struct QueryResult {
+    Query::Aggregate aggregate = Query::Aggregate::List;
+    size_t count = 0;
+    double value = 0.0;           // Aggregate value; unused for List
+    std::vector<uint32_t> rows;   // Matching rows for List
+    size_t blocksScanned = 0;
+    size_t blocksSkipped = 0;
+};
+
+// Splits on whitespace, keeping double-quoted text together (quotes removed)
+inline std::vector<std::string> tokenizeQuery(const std::string& text) {
+    std::vector<std::string> tokens;
+    std::string current;
+    bool quoted = false, inToken = false;
+    for (char c : text) {
+        if (c == '"') {
+            quoted = !quoted;
+            inToken = true;
+        } else if (!quoted && std::isspace(static_cast<unsigned char>(c))) {
+            if (inToken) tokens.push_back(current);
+            current.clear();
+            inToken = false;
+        } else {
+            current += c;
+            inToken = true;
+        }
+    }
+    if (inToken) tokens.push_back(current);
+    return tokens;
+}
+
+// Parses query text; on failure returns false and describes the problem in `error`
+inline bool parseQuery(const std::string& text, Query& query, std::string& error) {
+    query = Query{};
+    std::vector<std::string> tokens = tokenizeQuery(text);
+
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        const std::string word = toLower(tokens[i]);
+        if (i == 0 && (word == "list" || word == "count" || word == "sum" || word == "avg" || word == "min" || word == "max")) {
+            query.aggregate = word == "list" ? Query::Aggregate::List : word == "count" ? Query::Aggregate::Count
+                            : word == "sum" ? Query::Aggregate::Sum : word == "avg" ? Query::Aggregate::Avg
+                            : word == "min" ? Query::Aggregate::Min : Query::Aggregate::Max;
+            continue;
+        }
+        if (word == "order") {
+            std::string field = i + 1 < tokens.size() ? toLower(tokens[++i]) : "";
+            if (field == "by") field = i + 1 < tokens.size() ? toLower(tokens[++i]) : "";
+            if (field != "amount" && field != "date") {
+                error = "order expects 'amount' or 'date'";
+                return false;
+            }
+            query.orderBy = field == "amount" ? Query::OrderBy::Amount : Query::OrderBy::Date;
+            if (i + 1 < tokens.size() && (toLower(tokens[i + 1]) == "asc" || toLower(tokens[i + 1]) == "desc")) {
+                query.descending = toLower(tokens[++i]) == "desc";
+            }
+            continue;
+        }
+        if (word == "limit") {
+            std::string count = i + 1 < tokens.size() ? tokens[++i] : "";
+            char* end = nullptr;
+            long long n = std::strtoll(count.c_str(), &end, 10);
+            if (count.empty() || *end != '\0' || n <= 0) {
+                error = "limit expects a positive number";
+                return false;
+            }
+            query.limit = static_cast<size_t>(n);
+            continue;
+        }
+
+        // field<op>value
+        size_t pos = tokens[i].find_first_of("<>=~");
+        std::string op = pos == std::string::npos ? "" : tokens[i].substr(pos, 1);
+        if ((op == "<" || op == ">") && pos + 1 < tokens[i].size() && tokens[i][pos + 1] == '=') op += '=';
+        if (pos == std::string::npos || pos == 0) {
+            error = "unrecognised term '" + tokens[i] + "'";
+            return false;
+        }
+        const std::string field = toLower(tokens[i].substr(0, pos));
+        const std::string value = tokens[i].substr(pos + op.size());
+
+        if (field == "kind" && op == "=") {
+            std::string kind = toLower(value);
+            if (kind != "income" && kind != "expenditure") {
+                error = "kind must be income or expenditure";
+                return false;
+            }
+            query.kind = static_cast<int>(kind == "income" ? TransactionKind::Income : TransactionKind::Expenditure);
+        } else if (field == "category" && op == "=") {
+            query.hasCategory = true;
+            query.category = value;
+        } else if ((field == "desc" || field == "description") && op == "~") {
+            query.descriptionMatch = toLower(value);
+        } else if (field == "amount" && op != "~") {
+            char* end = nullptr;
+            double amount = std::strtod(value.c_str(), &end);
+            if (value.empty() || *end != '\0') {
+                error = "invalid amount '" + value + "'";
+                return false;
+            }
+            double above = std::nextafter(amount, std::numeric_limits<double>::infinity());
+            double below = std::nextafter(amount, -std::numeric_limits<double>::infinity());
+            if (op == "=" || op == ">=") query.minAmount = std::max(query.minAmount, amount);
+            if (op == "=" || op == "<=") query.maxAmount = std::min(query.maxAmount, amount);
+            if (op == ">") query.minAmount = std::max(query.minAmount, above);
+            if (op == "<") query.maxAmount = std::min(query.maxAmount, below);
+        } else if (field == "date" && op != "~") {
+            std::time_t day;
+            if (!parseDate(value, day)) {
+                error = "invalid date '" + value + "', expected YYYY-MM-DD";
+                return false;
+            }
+            std::time_t endOfDay = day + 86399;
+            if (op == "=" || op == ">=") query.from = std::max(query.from, day);
+            if (op == "=" || op == "<=") query.to = std::min(query.to, endOfDay);
+            if (op == ">") query.from = std::max(query.from, endOfDay + 1);
+            if (op == "<") query.to = std::min(query.to, day - 1);
+        } else {
+            error = "unsupported condition '" + tokens[i] + "'";
+            return false;
+        }
+    }
+    if (query.limit > 0 && query.aggregate != Query::Aggregate::List) {
+        error = "limit only applies to list queries";
+        return false;
+    }
+    return true;
+}
+
+// Results of recent queries keyed by normalized query text. An entry is
+// dropped only when a new transaction satisfies that query's conditions, so
+// writes outside a cached query's time range, category or kind keep it warm.
+class QueryCache {
+private:
+    static constexpr size_t MAX_ENTRIES = 64;
+    struct Entry {
+        Query query;
+        QueryResult result;
+    };
+    std::unordered_map<std::string, Entry> entries;
+    std::deque<std::string> insertionOrder;  // Oldest first, for eviction
+    size_t hits = 0;
+    size_t misses = 0;
+
+public:
+    const QueryResult* find(const std::string& key) {
+        auto it = entries.find(key);
+        if (it == entries.end()) {
+            ++misses;
+            return nullptr;
+        }
+        ++hits;
+        return &it->second.result;
+    }
+
+    const QueryResult& store(const std::string& key, const Query& query, QueryResult result) {
+        if (entries.size() >= MAX_ENTRIES) {
+            entries.erase(insertionOrder.front());
+            insertionOrder.pop_front();
+        }
+        insertionOrder.push_back(key);
+        Entry& entry = entries[key];
+        entry = Entry{query, std::move(result)};
+        return entry.result;
+    }
+
+    void invalidate(const Transaction& t) {
+        for (auto it = insertionOrder.begin(); it != insertionOrder.end();) {
+            auto entry = entries.find(*it);
+            if (entry->second.query.matches(t)) {
+                entries.erase(entry);
+                it = insertionOrder.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void clear() {
+        entries.clear();
+        insertionOrder.clear();
+    }
+
+    size_t size() const { return entries.size(); }
+    size_t getHits() const { return hits; }
+    size_t getMisses() const { return misses; }
+};
+
+// A transaction that repeats every `interval` days or months
+struct RecurringRule {
+    enum class Unit { Days, Months };
+
+    uint64_t id = 0;
+    TransactionKind kind = TransactionKind::Expenditure;
+    double amount = 0.0;
+    std::string description;
+    std::string category = "General";
+    Unit unit = Unit::Months;
+    int interval = 1;
+    std::time_t firstDue = 0;   // Anchor, so month-end dates do not drift
+    long occurrence = 0;        // Occurrences already materialized
+    std::time_t nextDue = 0;
+
+    void advance() {
+        ++occurrence;
+        nextDue = unit == Unit::Days ? firstDue + static_cast<std::time_t>(occurrence * interval) * 86400
+                                     : addMonths(firstDue, static_cast<int>(occurrence * interval));
+    }
+
+    std::unique_ptr<Transaction> materialize(std::time_t when) const {
+        if (kind == TransactionKind::Income) return std::make_unique<Income>(amount, description, category, when);
+        return std::make_unique<Expenditure>(amount, description, category, when);
+    }
+};
+
+// One due occurrence and the rule that produced it (0 if unknown)
+struct RecurringOccurrence {
+    uint64_t ruleId = 0;
+    std::unique_ptr<Transaction> transaction;
+};
+
+// Hierarchical timer wheel with one-day ticks. Level 0 has a slot per day for
+// the next 256 days; each higher level has 64 slots covering 64x the span of
+// the level below, and its slots are cascaded down as time reaches them. Long
+// gaps (e.g. catching up after downtime) skip the ticking and drain every
+// slot in one pass instead.
+class TimerWheel {
+private:
+    static constexpr int LEVELS = 4;
+    static constexpr int LEVEL0_BITS = 8;
+    static constexpr int LEVEL_BITS = 6;
+    static constexpr long BULK_THRESHOLD_DAYS = 256;
+
+    struct Timer {
+        uint64_t id;
+        long due;
+    };
+
+    std::array<std::vector<std::vector<Timer>>, LEVELS> levels;
+    std::vector<Timer> overdue;
+    long current = 0;
+    size_t pending = 0;
+
+    static int shiftFor(int level) { return level == 0 ? 0 : LEVEL0_BITS + (level - 1) * LEVEL_BITS; }
+
+    void place(const Timer& timer) {
+        long delta = timer.due - current;
+        if (delta <= 0) {
+            overdue.push_back(timer);
+            return;
+        }
+        int level = 0;
+        while (level + 1 < LEVELS && delta >= (1L << shiftFor(level + 1))) ++level;
+        auto& slots = levels[static_cast<size_t>(level)];
+        slots[static_cast<size_t>((timer.due >> shiftFor(level)) & static_cast<long>(slots.size() - 1))].push_back(timer);
+    }
+
+    void cascade(int level) {
+        auto& slots = levels[static_cast<size_t>(level)];
+        std::vector<Timer> moving;
+        moving.swap(slots[static_cast<size_t>((current >> shiftFor(level)) & static_cast<long>(slots.size() - 1))]);
+        for (const Timer& timer : moving) place(timer);
+    }
+
+public:
+    TimerWheel() {
+        levels[0].resize(size_t{1} << LEVEL0_BITS);
+        for (int level = 1; level < LEVELS; ++level) levels[static_cast<size_t>(level)].resize(size_t{1} << LEVEL_BITS);
+    }
+
+    void setCurrentDay(long day) {
+        if (pending == 0) current = day;
+    }
+
+    void schedule(uint64_t id, long dueDay) {
+        ++pending;
+        place(Timer{id, dueDay});
+    }
+
+    // Moves time forward to `day`, appending the ids of every timer due on or before it
+    void advanceTo(long day, std::vector<uint64_t>& fired) {
+        auto fire = [&](const Timer& timer) {
+            fired.push_back(timer.id);
+            --pending;
+        };
+        for (const Timer& timer : overdue) fire(timer);
+        overdue.clear();
+        if (day <= current) return;
+
+        if (day - current >= BULK_THRESHOLD_DAYS) {
+            std::vector<Timer> all;
+            for (auto& slots : levels) {
+                for (auto& slot : slots) {
+                    all.insert(all.end(), slot.begin(), slot.end());
+                    slot.clear();
+                }
+            }
+            current = day;
+            for (const Timer& timer : all) {
+                if (timer.due <= day) fire(timer);
+                else place(timer);
+            }
+            return;
+        }
+
+        while (current < day) {
+            ++current;
+            for (int level = LEVELS - 1; level >= 1; --level) {
+                if ((current & ((1L << shiftFor(level)) - 1)) == 0) cascade(level);
+            }
+            auto& slot = levels[0][static_cast<size_t>(current & ((1L << LEVEL0_BITS) - 1))];
+            std::vector<Timer> due;
+            due.swap(slot);
+            for (const Timer& timer : due) {
+                if (timer.due <= current) fire(timer);
+                else place(timer);
+            }
+        }
+    }
+
+    size_t size() const { return pending; }
+};
+
+// Recurring rules indexed by a timer wheel on their next due day
+class RecurringScheduler {
+private:
+    std::map<uint64_t, RecurringRule> rules;
+    TimerWheel wheel;
+    uint64_t nextId = 1;
+    bool started = false;
+
+public:
+    uint64_t addRule(RecurringRule rule) {
+        if (!started) {
+            wheel.setCurrentDay(std::min(dayIndex(std::time(nullptr)), dayIndex(rule.nextDue) - 1));
+            started = true;
+        }
+        if (rule.occurrence == 0) rule.firstDue = rule.nextDue;
+        rule.id = rule.id ? rule.id : nextId;
+        nextId = std::max(nextId, rule.id + 1);
+        wheel.schedule(rule.id, dayIndex(rule.nextDue));
+        return rules.emplace(rule.id, std::move(rule)).first->first;
+    }
+
+    // Removed rules are skipped lazily when their timer fires
+    bool removeRule(uint64_t id) { return rules.erase(id) > 0; }
+
+    // Every occurrence due on or before `now`, oldest first. A rule that missed
+    // several occurrences (downtime) has all of them generated in one go.
+    // The ids of rules that produced occurrences are appended to `advanced`.
+    std::vector<RecurringOccurrence> collectDue(std::time_t now, std::vector<uint64_t>* advanced = nullptr) {
+        std::vector<uint64_t> fired;
+        wheel.advanceTo(dayIndex(now), fired);
+        std::vector<RecurringOccurrence> batch;
+        for (uint64_t id : fired) {
+            auto it = rules.find(id);
+            if (it == rules.end()) continue;
+            RecurringRule& rule = it->second;
+            if (advanced && rule.nextDue <= now) advanced->push_back(id);
+            while (rule.nextDue <= now) {
+                batch.push_back({id, rule.materialize(rule.nextDue)});
+                rule.advance();
+            }
+            wheel.schedule(id, dayIndex(rule.nextDue));
+        }
+        std::stable_sort(batch.begin(), batch.end(), [](const auto& a, const auto& b) {
+            return a.transaction->getTimestamp() < b.transaction->getTimestamp();
+        });
+        return batch;
+    }
+
+    const std::map<uint64_t, RecurringRule>& getRules() const { return rules; }
+
+    // Id of a rule that books exactly `t`, or 0
+    uint64_t findRule(const Transaction& t) const {
+        for (const auto& entry : rules) {
+            const RecurringRule& rule = entry.second;
+            if (rule.kind == t.getKind() && rule.amount == t.getAmount() && rule.category == t.getCategory()
+                && rule.description == t.getDescription()) {
+                return entry.first;
+            }
+        }
+        return 0;
+    }
+
+    void write(std::ostream& out) const {
+        out << "RULES " << rules.size() << '\n';
+        for (const auto& entry : rules) {
+            const RecurringRule& rule = entry.second;
+            out << rule.id << '\t' << static_cast<int>(rule.kind) << '\t' << std::setprecision(17) << rule.amount
+                << '\t' << static_cast<int>(rule.unit) << '\t' << rule.interval << '\t'
+                << static_cast<long long>(rule.firstDue) << '\t' << rule.occurrence << '\t'
+                << rule.category << '\t' << rule.description << '\n';
+        }
+    }
+
+    bool read(std::istream& in) {
+        std::string section, line;
+        size_t n = 0;
+        if (!(in >> section >> n) || section != "RULES") return false;
+        std::getline(in, line);
+        for (size_t i = 0; i < n; ++i) {
+            if (!std::getline(in, line)) return false;
+            std::istringstream fields(line);
+            RecurringRule rule;
+            int kind = 0, unit = 0;
+            long long first = 0;
+            char tab;
+            if (!(fields >> rule.id >> kind >> rule.amount >> unit >> rule.interval >> first >> rule.occurrence) || !fields.get(tab)
+                || !std::getline(fields, rule.category, '\t')) {
+                return false;
+            }
+            std::getline(fields, rule.description);
+            rule.kind = kind == 0 ? TransactionKind::Income : TransactionKind::Expenditure;
+            rule.unit = unit == 0 ? RecurringRule::Unit::Days : RecurringRule::Unit::Months;
+            rule.firstDue = static_cast<std::time_t>(first);
+            rule.occurrence -= 1;
+            rule.advance();  // Recomputes nextDue from the anchor
+            addRule(std::move(rule));
+        }
+        return true;
+    }
+};
+
+// Projects the balance month by month from the recurring rules, the only
+// future flows the app actually books (SIP installments are never deducted
+// from the balance, so they are left out). Each rule's monthly contribution
+// is kept separately, so adding, removing or advancing one rule only
+// recomputes that rule's series instead of the whole forecast.
+class CashFlowForecaster {
+public:
+    static constexpr int HORIZON = 24;
+    using Series = std::array<double, HORIZON>;
+
+    struct Projection {
+        int firstMonth = 0;
+        double opening = 0.0;  // Balance now
+        double owed = 0.0;     // Deferred expenses, paid before the first month's flows
+        Series net{};
+        Series balance{};      // End-of-month balance
+        int firstDip = -1;     // First month index under the minimum, or -1
+    };
+
+private:
+    int baseMonth = std::numeric_limits<int>::min();
+    std::map<uint64_t, Series> contributions;  // By rule id
+    Series net{};
+
+public:
+    bool isBuilt() const { return baseMonth != std::numeric_limits<int>::min(); }
+    bool isBuiltFor(int month) const { return baseMonth == month; }
+
+    void reset(int month) {
+        baseMonth = month;
+        contributions.clear();
+        net.fill(0.0);
+    }
+
+    void setContribution(uint64_t id, const Series& series) {
+        removeContribution(id);
+        for (int m = 0; m < HORIZON; ++m) net[m] += series[m];
+        contributions[id] = series;
+    }
+
+    void removeContribution(uint64_t id) {
+        auto it = contributions.find(id);
+        if (it == contributions.end()) return;
+        for (int m = 0; m < HORIZON; ++m) net[m] -= it->second[m];
+        contributions.erase(it);
+    }
+
+    // Occurrences still to come; ones already due count towards this month
+    Series ruleSeries(RecurringRule rule) const {
+        Series series{};
+        double signedAmount = rule.kind == TransactionKind::Income ? rule.amount : -rule.amount;
+        for (int month = monthIndex(rule.nextDue); month < baseMonth + HORIZON; month = monthIndex(rule.nextDue)) {
+            series[static_cast<size_t>(std::max(0, month - baseMonth))] += signedAmount;
+            rule.advance();
+        }
+        return series;
+    }
+
+    Projection project(double startBalance, double minimumBalance, double owed = 0.0) const {
+        Projection projection;
+        projection.firstMonth = baseMonth;
+        projection.opening = startBalance;
+        projection.owed = owed;
+        projection.net = net;
+        std::partial_sum(net.begin(), net.end(), projection.balance.begin());
+        for (int m = 0; m < HORIZON; ++m) {
+            projection.balance[m] += startBalance - owed;
+            if (projection.firstDip < 0 && projection.balance[m] < minimumBalance) projection.firstDip = m;
+        }
+        return projection;
+    }
+};
+
+// A spending cap for one category (or all, when category is empty) per week or month
+struct Budget {
+    enum class Period { Weekly, Monthly };
+
+    uint64_t id = 0;
+    std::string category;
+    Period period = Period::Monthly;
+    double limit = 0.0;
+
+    // Progress in the current period
+    long currentPeriod = std::numeric_limits<long>::min();
+    double spent = 0.0;
+    int thresholdsFired = 0;  // How many of BudgetEngine::THRESHOLDS have fired
+
+    long periodOf(std::time_t when) const {
+        long day = dayIndex(when);
+        // Weeks start on Monday; 1970-01-01 was a Thursday
+        return period == Period::Monthly ? monthIndex(when) : (day + 3 >= 0 ? (day + 3) / 7 : (day + 3 - 6) / 7);
+    }
+};
+
+struct BudgetAlert {
+    uint64_t budgetId;
+    std::string category;
+    double threshold;  // Fraction of the limit that was crossed
+    double spent;
+    double limit;
+};
+
+// Budgets indexed by category so each expenditure touches only its own
+// category's budgets plus the all-category ones, however many budgets exist
+class BudgetEngine {
+public:
+    static constexpr std::array<double, 3> THRESHOLDS{{0.5, 0.8, 1.0}};
+
+private:
+    std::map<uint64_t, Budget> budgets;
+    std::unordered_map<std::string, std::vector<uint64_t>> byCategory;  // "" holds all-category budgets
+    uint64_t nextId = 1;
+
+    void track(Budget& budget, std::time_t when, double amount, std::vector<BudgetAlert>& alerts) {
+        long period = budget.periodOf(when);
+        if (period < budget.currentPeriod) return;  // Back-dated into a closed period
+        if (period > budget.currentPeriod) {
+            budget.currentPeriod = period;
+            budget.spent = 0.0;
+            budget.thresholdsFired = 0;
+        }
+        budget.spent += amount;
+        while (budget.thresholdsFired < static_cast<int>(THRESHOLDS.size())
+               && budget.spent >= THRESHOLDS[static_cast<size_t>(budget.thresholdsFired)] * budget.limit) {
+            alerts.push_back({budget.id, budget.category, THRESHOLDS[static_cast<size_t>(budget.thresholdsFired)],
+                              budget.spent, budget.limit});
+            ++budget.thresholdsFired;
+        }
+    }
+
+public:
+    uint64_t addBudget(Budget budget) {
+        budget.id = budget.id ? budget.id : nextId;
+        nextId = std::max(nextId, budget.id + 1);
+        byCategory[budget.category].push_back(budget.id);
+        return budgets.emplace(budget.id, std::move(budget)).first->first;
+    }
+
+    // Opens the budget's period containing `now` with what was already spent
+    // in it, raising any thresholds that amount has crossed
+    void seed(uint64_t id, std::time_t now, double spent, std::vector<BudgetAlert>& alerts) {
+        auto it = budgets.find(id);
+        if (it != budgets.end()) track(it->second, now, spent, alerts);
+    }
+
+    bool removeBudget(uint64_t id) {
+        auto it = budgets.find(id);
+        if (it == budgets.end()) return false;
+        auto& ids = byCategory[it->second.category];
+        ids.erase(std::remove(ids.begin(), ids.end(), id), ids.end());
+        budgets.erase(it);
+        return true;
+    }
+
+    // Updates the budgets an expenditure touches and reports newly crossed thresholds
+    void onTransaction(const Transaction& t, std::vector<BudgetAlert>& alerts) {
+        if (t.getKind() != TransactionKind::Expenditure) return;
+        auto visit = [&](const std::string& key) {
+            auto it = byCategory.find(key);
+            if (it == byCategory.end()) return;
+            for (uint64_t id : it->second) track(budgets[id], t.getTimestamp(), t.getAmount(), alerts);
+        };
+        visit(t.getCategory());
+        if (!t.getCategory().empty()) visit(std::string());
+    }
+
+    const std::map<uint64_t, Budget>& getBudgets() const { return budgets; }
+
+    void write(std::ostream& out) const {
+        out << "BUDGETS " << budgets.size() << '\n';
+        for (const auto& entry : budgets) {
+            const Budget& b = entry.second;
+            out << b.id << '\t' << static_cast<int>(b.period) << '\t' << std::setprecision(17) << b.limit << '\t'
+                << b.currentPeriod << '\t' << b.spent << '\t' << b.thresholdsFired << '\t' << b.category << '\n';
+        }
+    }
+
+    bool read(std::istream& in) {
+        std::string section, line;
+        size_t n = 0;
+        if (!(in >> section >> n) || section != "BUDGETS") return false;
+        std::getline(in, line);
+        for (size_t i = 0; i < n; ++i) {
+            if (!std::getline(in, line)) return false;
+            std::istringstream fields(line);
+            Budget budget;
+            int period = 0;
+            char tab;
+            if (!(fields >> budget.id >> period >> budget.limit >> budget.currentPeriod >> budget.spent
+                         >> budget.thresholdsFired) || !fields.get(tab)) {
+                return false;
+            }
+            std::getline(fields, budget.category);
+            budget.period = period == 0 ? Budget::Period::Weekly : Budget::Period::Monthly;
+            addBudget(std::move(budget));
+        }
+        return true;
+    }
+};
+
+#ifdef FINANCE_HAVE_IO_URING
+// Just enough of io_uring for the journal: a write linked to an fdatasync,
+// submitted and waited on with one system call per batch
+class IoUring {
+private:
+    int ringFd = -1;
+    void* sqRing = MAP_FAILED;
+    void* cqRing = MAP_FAILED;
+    size_t sqRingSize = 0, cqRingSize = 0, sqesSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    unsigned *sqTail = nullptr, *sqMask = nullptr, *sqArray = nullptr;
+    unsigned *cqHead = nullptr, *cqTail = nullptr, *cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    void push(const io_uring_sqe& entry) {
+        unsigned tail = *sqTail;
+        unsigned index = tail & *sqMask;
+        sqes[index] = entry;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+public:
+    IoUring() = default;
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    ~IoUring() {
+        if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        if (ringFd >= 0) close(ringFd);
+    }
+
+    // False when the kernel does not offer io_uring (or forbids it)
+    bool open(unsigned entries) {
+        io_uring_params params{};
+        ringFd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ringFd < 0) return false;
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMap) sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) return false;
+        cqRing = singleMap ? sqRing
+                           : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) return false;
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                               ringFd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED) return false;
+
+        char* sq = static_cast<char*>(sqRing);
+        char* cq = static_cast<char*>(cqRing);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    // Writes all of `data` at `offset`, then syncs. A short write cancels the
+    // linked sync, so the rest is resubmitted with a fresh sync.
+    bool writeAndSync(int fd, const char* data, size_t length, off_t offset) {
+        enum : uint64_t { WRITE = 1, SYNC = 2 };
+        while (true) {
+            io_uring_sqe write{};
+            write.opcode = IORING_OP_WRITE;
+            write.fd = fd;
+            write.addr = reinterpret_cast<uint64_t>(data);
+            write.len = static_cast<uint32_t>(length);
+            write.off = static_cast<uint64_t>(offset);
+            write.flags = IOSQE_IO_LINK;
+            write.user_data = WRITE;
+            io_uring_sqe sync{};
+            sync.opcode = IORING_OP_FSYNC;
+            sync.fd = fd;
+            sync.fsync_flags = IORING_FSYNC_DATASYNC;
+            sync.user_data = SYNC;
+            push(write);
+            push(sync);
+
+            int written = -1, synced = -1;
+            unsigned submit = 2, reaped = 0;
+            while (reaped < 2) {
+                long entered = syscall(__NR_io_uring_enter, ringFd, submit, 2 - reaped, IORING_ENTER_GETEVENTS, nullptr, 0);
+                if (entered < 0 && errno != EINTR) return false;
+                if (entered > 0) submit -= std::min(submit, static_cast<unsigned>(entered));
+                unsigned head = *cqHead;
+                for (; head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE); ++head, ++reaped) {
+                    const io_uring_cqe& done = cqes[head & *cqMask];
+                    (done.user_data == WRITE ? written : synced) = done.res;
+                }
+                __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+            }
+            if (written < 0) return false;
+            if (static_cast<size_t>(written) == length) return synced == 0;
+            data += written;
+            length -= static_cast<size_t>(written);
+            offset += written;
+        }
+    }
+};
+#endif
+
+// Replaces `path` with the finished file at `tmpPath` so that a crash leaves
+// either the old or the new contents: the new file is synced, renamed over
+// the old one, and the directory entry is synced as well
+inline bool replaceFileDurably(const std::string& tmpPath, const std::string& path) {
+#ifdef FINANCE_HAVE_FSYNC
+    int fd = ::open(tmpPath.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool synced = fsync(fd) == 0;
+    close(fd);
+    if (!synced || std::rename(tmpPath.c_str(), path.c_str()) != 0) return false;
+    std::string directory = std::filesystem::path(path).parent_path().string();
+    int dirFd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+    if (dirFd < 0) return false;
+    synced = fsync(dirFd) == 0;
+    close(dirFd);
+    return synced;
+#else
+    std::error_code error;
+    std::filesystem::rename(tmpPath, path, error);
+    return !error;
+#endif
+}
+
+// A transaction read back from the journal with its sequence number
+// (0 for records written before records were numbered)
+struct JournalRecord {
+    uint64_t sequence = 0;
+    std::unique_ptr<Transaction> transaction;
+};
+
+// Appends transaction records to a journal file from a background thread.
+// Records queued while a batch is being written go out together in the next
+// batch, which a single sync makes durable (group commit). append() returns at
+// once with the sequence number of its last line; drain() waits for
+// durability, and records that could not be written are counted for the
+// caller to report. Every line is numbered "<sequence>\t<record>", and
+// numbers keep rising across truncation (a "SEQUENCE n" header carries the
+// count over), so a snapshot can name the last record it holds. io_uring is used where the kernel
+// offers it, with a plain write and fsync otherwise (or after a ring failure).
+class JournalWriter {
+public:
+    struct Stats {
+        std::string backend;
+        uint64_t records = 0;
+        uint64_t batches = 0;
+        uint64_t bytes = 0;
+        uint64_t failed = 0;       // Records whose batch could not be made durable
+        double busySeconds = 0.0;  // Time spent writing and syncing
+        double p50 = 0.0, p99 = 0.0, p999 = 0.0;  // Append-to-durable latency, microseconds
+    };
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Pending {
+        std::string record;
+        Clock::time_point queuedAt;
+    };
+
+    std::string path;
+    int fd = -1;
+    off_t offset = 0;
+#ifdef FINANCE_HAVE_IO_URING
+    IoUring ring;
+    std::atomic<bool> useRing{false};
+#endif
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable drained;
+    std::vector<Pending> queue;
+    uint64_t sequence = 0;  // Last number handed out
+    bool heldRecords = false;  // The file had records when it was opened
+    bool writing = false;
+    bool stopping = false;
+    std::thread worker;
+
+    mutable std::mutex statsLock;
+    Stats totals;
+    LatencyHistogram latency;  // Append-to-durable, written by the worker only
+    std::atomic<uint64_t> unreportedFailures{0};
+
+    bool writeBatch(const std::string& data) {
+#ifdef FINANCE_HAVE_IO_URING
+        // A failed submission retries the whole batch (same offset) with
+        // pwrite, which stays the backend from then on
+        if (useRing && ring.writeAndSync(fd, data.data(), data.size(), offset)) return true;
+        useRing = false;
+#endif
+#ifdef FINANCE_HAVE_FSYNC
+        for (size_t done = 0; done < data.size();) {
+            ssize_t written = pwrite(fd, data.data() + done, data.size() - done, offset + static_cast<off_t>(done));
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            done += static_cast<size_t>(written);
+        }
+        return fsync(fd) == 0;
+#else
+        return false;
+#endif
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            wake.wait(guard, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) return;
+            std::vector<Pending> batch;
+            batch.swap(queue);
+            writing = true;
+            guard.unlock();
+
+            std::string data;
+            for (const Pending& pending : batch) data += pending.record;
+            Clock::time_point started = Clock::now();
+            bool ok;
+            {
+                TRACE_SPAN("JournalWriter::writeBatch");
+                ok = writeBatch(data);
+            }
+            Clock::time_point finished = Clock::now();
+            if (ok) offset += static_cast<off_t>(data.size());
+            else unreportedFailures += batch.size();
+            {
+                std::lock_guard<std::mutex> statsGuard(statsLock);
+                if (!ok) totals.failed += batch.size();
+                totals.records += batch.size();
+                totals.batches += 1;
+                totals.bytes += data.size();
+                totals.busySeconds += std::chrono::duration<double>(finished - started).count();
+                for (const Pending& pending : batch) {
+                    latency.record(static_cast<uint64_t>(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(finished - pending.queuedAt).count()));
+                }
+            }
+
+            guard.lock();
+            writing = false;
+            drained.notify_all();
+        }
+    }
+
+public:
+    explicit JournalWriter(std::string journalPath) : path(std::move(journalPath)) {
+#ifdef FINANCE_HAVE_FSYNC
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+        if (fd < 0) return;
+        offset = lseek(fd, 0, SEEK_END);
+        std::ifstream existing(path);
+        std::string line;
+        while (std::getline(existing, line)) {
+            bool header = line.rfind("SEQUENCE ", 0) == 0;
+            const char* number = header ? line.c_str() + 9 : line.c_str();
+            heldRecords = heldRecords || (!header && !line.empty());
+            if (std::isdigit(static_cast<unsigned char>(*number))) {
+                sequence = std::max<uint64_t>(sequence, std::strtoull(number, nullptr, 10));
+            }
+        }
+#ifdef FINANCE_HAVE_IO_URING
+        useRing = ring.open(8);
+#endif
+        worker = std::thread(&JournalWriter::run, this);
+#endif
+    }
+
+    ~JournalWriter() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        if (worker.joinable()) worker.join();
+#ifdef FINANCE_HAVE_FSYNC
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    JournalWriter(const JournalWriter&) = delete;
+    JournalWriter& operator=(const JournalWriter&) = delete;
+
+    bool isOpen() const { return fd >= 0; }
+    const std::string& getPath() const { return path; }
+    bool heldRecordsAtOpen() const { return heldRecords; }
+
+    // Queues one or more newline-terminated lines; returns the sequence
+    // number given to the last of them
+    uint64_t append(const std::string& lines) {
+        uint64_t last;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            std::string record;
+            record.reserve(lines.size() + 16);
+            for (size_t begin = 0; begin < lines.size();) {
+                size_t end = lines.find('\n', begin);
+                end = end == std::string::npos ? lines.size() : end + 1;
+                record += std::to_string(++sequence);
+                record += '\t';
+                record.append(lines, begin, end - begin);
+                begin = end;
+            }
+            last = sequence;
+            queue.push_back(Pending{std::move(record), Clock::now()});
+        }
+        wake.notify_one();
+        return last;
+    }
+
+    // Numbers later records above `last`, e.g. a loaded snapshot's position
+    void continueAfter(uint64_t last) {
+        std::lock_guard<std::mutex> guard(lock);
+        sequence = std::max(sequence, last);
+    }
+
+    // Records that failed to become durable since the last call
+    uint64_t takeFailures() { return unreportedFailures.exchange(0); }
+
+    // Waits until every record appended so far has been written
+    void drain() {
+        std::unique_lock<std::mutex> guard(lock);
+        drained.wait(guard, [this] { return queue.empty() && !writing; });
+    }
+
+    // Empties the journal once a snapshot holds everything in it, keeping
+    // the sequence count in a header line
+    bool truncate() {
+        drain();
+        std::lock_guard<std::mutex> guard(lock);
+#ifdef FINANCE_HAVE_FSYNC
+        std::string header = "SEQUENCE " + std::to_string(sequence) + "\n";
+        if (fd < 0 || ftruncate(fd, 0) != 0
+            || pwrite(fd, header.data(), header.size(), 0) != static_cast<ssize_t>(header.size()) || fsync(fd) != 0) {
+            return false;
+        }
+        offset = static_cast<off_t>(header.size());
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Complete records in the journal; a torn final line from a crash is dropped
+    std::vector<JournalRecord> readRecords() {
+        drain();
+        std::vector<JournalRecord> records;
+        std::ifstream in(path);
+        std::string line;
+        while (std::getline(in, line) && !in.eof()) {
+            if (line.rfind("SEQUENCE ", 0) == 0) continue;
+            JournalRecord record;
+            size_t start = 0;
+            if (!line.empty() && std::isdigit(static_cast<unsigned char>(line[0]))) {
+                size_t tab = line.find('\t');
+                if (tab == std::string::npos) break;
+                record.sequence = std::strtoull(line.c_str(), nullptr, 10);
+                start = tab + 1;
+            }
+            record.transaction = parseTransaction(line.substr(start));
+            if (!record.transaction) break;
+            records.push_back(std::move(record));
+        }
+        return records;
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> guard(statsLock);
+        Stats result = totals;
+#ifdef FINANCE_HAVE_IO_URING
+        result.backend = useRing ? "io_uring" : "write+fsync";
+#else
+        result.backend = "write+fsync";
+#endif
+        LatencyHistogram::Counts counts = latency.counts();
+        result.p50 = counts.percentile(0.5) / 1000.0;
+        result.p99 = counts.percentile(0.99) / 1000.0;
+        result.p999 = counts.percentile(0.999) / 1000.0;
+        return result;
+    }
+};
+
+// Bounded single-producer/single-consumer ring. Each index is written by one
+// side only, so push and pop need no locks; a full ring is how a slow
+// consumer pushes back on its producer.
+template<typename T>
+class SpscQueue {
+private:
+    std::vector<T> slots;
+    const size_t mask;
+    alignas(64) std::atomic<size_t> head{0};  // Next slot to pop, written by the consumer
+    alignas(64) std::atomic<size_t> tail{0};  // Next slot to fill, written by the producer
+
+public:
+    // Capacity is rounded up to a power of two
+    explicit SpscQueue(size_t capacity)
+        : slots(size_t{1} << static_cast<size_t>(std::ceil(std::log2(std::max<size_t>(2, capacity))))),
+          mask(slots.size() - 1) {}
+
+    bool tryPush(T& value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots.size()) return false;
+        slots[t & mask] = std::move(value);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& value) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        value = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Blocking forms: back off by yielding while the ring is full or empty
+    void push(T value) {
+        while (!tryPush(value)) std::this_thread::yield();
+    }
+
+    T pop() {
+        T value;
+        while (!tryPop(value)) std::this_thread::yield();
+        return value;
+    }
+};
+
+struct ImportResult {
+    size_t imported = 0;
+    size_t rejected = 0;      // Expenditures that would have broken the minimum balance
+    size_t overLimit = 0;     // Expenditures that would have broken a rolling limit
+    size_t unusual = 0;       // Imported expenditures the anomaly model flagged
+    size_t invalidDates = 0;  // Rows dated on days that do not exist, e.g. 2026-02-31
+    size_t malformed = 0;     // Lines that could not be parsed
+    double balance = 0.0;
+    double seconds = 0.0;
+};
+
+// Bulk import of CSV lines "YYYY-MM-DD,type,amount,category,description" in
+// three pipelined stages:
+//   1. parser threads each take every Nth fixed-size chunk of the file;
+//   2. one validator takes chunks back in file order and runs each
+//      expenditure through a SpendingGuard, dropping those that break the
+//      minimum balance or a rolling limit and counting unusual ones (there is
+//      nobody to confirm them, so they are imported);
+//   3. the calling thread, the only writer, applies accepted batches.
+// Stages are joined by bounded SPSC queues (one per parser, so the validator
+// restores file order by visiting them round-robin), which stalls fast stages
+// instead of buffering the whole file.
+class ImportPipeline {
+public:
+    using Batch = std::vector<std::unique_ptr<Transaction>>;
+    using Apply = std::function<void(Batch)>;
+
+private:
+    static constexpr std::streamoff CHUNK_BYTES = 1 << 20;
+    static constexpr size_t QUEUE_CHUNKS = 4;
+
+    struct ParsedChunk {
+        Batch rows;
+        size_t malformed = 0;
+        size_t invalidDates = 0;
+    };
+
+    struct ValidatedBatch {
+        Batch rows;
+        bool last = false;
+    };
+
+    // Null for a line that cannot be imported; `invalidDate` is set when the
+    // date is well formed but names a day that does not exist
+    static std::unique_ptr<Transaction> parseLine(const std::string& line, bool& invalidDate) {
+        std::istringstream fields(line);
+        std::string dateText, type, amountText, category, description;
+        int y = 0; unsigned m = 0, d = 0;
+        if (!std::getline(fields, dateText, ',') || !std::getline(fields, type, ',')
+            || !std::getline(fields, amountText, ',') || !scanDate(dateText, y, m, d)) {
+            return nullptr;
+        }
+        if (!isCalendarDate(y, m, d)) {
+            invalidDate = true;
+            return nullptr;
+        }
+        std::time_t when = static_cast<std::time_t>(daysFromCivil(y, m, d) * 86400L);
+        std::getline(fields, category, ',');
+        std::getline(fields, description);
+        if (!description.empty() && description.back() == '\r') description.pop_back();
+        char* end = nullptr;
+        double amount = std::strtod(amountText.c_str(), &end);
+        if (end == amountText.c_str() || !(amount > 0.0)) return nullptr;
+        if (category.empty()) category = "General";
+        type = toLower(type);
+        if (type == "income") return std::make_unique<Income>(amount, description, category, when);
+        if (type == "expenditure" || type == "expense") return std::make_unique<Expenditure>(amount, description, category, when);
+        return nullptr;
+    }
+
+    // A line belongs to the chunk holding its first byte
+    static ParsedChunk parseChunk(std::ifstream& in, std::streamoff begin, std::streamoff end) {
+        TRACE_SPAN("ImportPipeline::parseChunk");
+        ParsedChunk chunk;
+        std::string line;
+        in.clear();
+        in.seekg(begin > 0 ? begin - 1 : 0);
+        std::streamoff position = begin > 0 ? begin - 1 : 0;
+        if (begin > 0 && std::getline(in, line)) position += static_cast<std::streamoff>(line.size()) + 1;
+        while (position < end && std::getline(in, line)) {
+            bool header = position == 0 && line.rfind("date,", 0) == 0;
+            position += static_cast<std::streamoff>(line.size()) + 1;
+            if (header || line.empty() || line == "\r") continue;
+            bool invalidDate = false;
+            std::unique_ptr<Transaction> t = parseLine(line, invalidDate);
+            if (t) chunk.rows.push_back(std::move(t));
+            else if (invalidDate) ++chunk.invalidDates;
+            else ++chunk.malformed;
+        }
+        return chunk;
+    }
+
+public:
+    // The guard's anomaly model must not change while the pipeline runs
+    static bool run(const std::string& path, SpendingGuard guard, const Apply& apply, ImportResult& result) {
+        std::error_code error;
+        std::streamoff size = static_cast<std::streamoff>(std::filesystem::file_size(path, error));
+        if (error) return false;
+        auto started = std::chrono::steady_clock::now();
+        size_t chunkCount = static_cast<size_t>((size + CHUNK_BYTES - 1) / CHUNK_BYTES);
+        size_t parserCount = std::max<size_t>(1, std::min<size_t>(chunkCount, std::thread::hardware_concurrency()));
+
+        std::vector<std::unique_ptr<SpscQueue<ParsedChunk>>> parsed;
+        for (size_t p = 0; p < parserCount; ++p) parsed.push_back(std::make_unique<SpscQueue<ParsedChunk>>(QUEUE_CHUNKS));
+        SpscQueue<ValidatedBatch> validated(QUEUE_CHUNKS);
+
+        std::vector<std::thread> parsers;
+        for (size_t p = 0; p < parserCount; ++p) {
+            parsers.emplace_back([&, p] {
+                std::ifstream in(path, std::ios::binary);
+                for (size_t c = p; c < chunkCount; c += parserCount) {
+                    std::streamoff begin = static_cast<std::streamoff>(c) * CHUNK_BYTES;
+                    parsed[p]->push(parseChunk(in, begin, std::min(size, begin + CHUNK_BYTES)));
+                }
+            });
+        }
+
+        size_t malformed = 0, invalidDates = 0, rejected = 0, overLimit = 0, unusual = 0;
+        std::thread validator([&] {
+            for (size_t c = 0; c < chunkCount; ++c) {
+                ParsedChunk chunk = parsed[c % parserCount]->pop();
+                malformed += chunk.malformed;
+                invalidDates += chunk.invalidDates;
+                ValidatedBatch batch;
+                for (auto& t : chunk.rows) {
+                    if (t->getKind() == TransactionKind::Expenditure) {
+                        SpendingGuard::Verdict verdict = guard.check(t->getAmount(), t->getCategory(), t->getTimestamp()).verdict;
+                        if (verdict == SpendingGuard::Verdict::BelowMinimum) {
+                            ++rejected;
+                            continue;
+                        }
+                        if (verdict == SpendingGuard::Verdict::OverLimit) {
+                            ++overLimit;
+                            continue;
+                        }
+                        if (verdict == SpendingGuard::Verdict::Unusual) ++unusual;
+                    }
+                    guard.accept(*t);
+                    batch.rows.push_back(std::move(t));
+                }
+                validated.push(std::move(batch));
+            }
+            ValidatedBatch last;
+            last.last = true;
+            validated.push(std::move(last));
+            result.balance = guard.getBalance();
+        });
+
+        size_t imported = 0;
+        while (true) {
+            ValidatedBatch batch = validated.pop();
+            if (batch.last) break;
+            imported += batch.rows.size();
+            if (!batch.rows.empty()) apply(std::move(batch.rows));
+        }
+        validator.join();
+        for (auto& parser : parsers) parser.join();
+
+        result.imported = imported;
+        result.rejected = rejected;
+        result.overLimit = overLimit;
+        result.unusual = unusual;
+        result.invalidDates = invalidDates;
+        result.malformed = malformed;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        return true;
+    }
+};
+
+// Epoch-based reclamation for objects that lock-free readers may still be
+// using. A reader pins the global epoch for as long as it holds references;
+// a retired object is freed only once no reader pinned at or before the epoch
+// it was retired in remains.
+class EpochManager {
+public:
+    static constexpr size_t MAX_READERS = 64;
+
+private:
+    static constexpr uint64_t IDLE = std::numeric_limits<uint64_t>::max();
+    std::atomic<uint64_t> globalEpoch{1};
+    std::array<std::atomic<uint64_t>, MAX_READERS> readerEpochs;
+    std::mutex retiredLock;
+    std::vector<std::pair<uint64_t, std::function<void()>>> retired;
+
+    void reclaimLocked() {
+        uint64_t oldestPinned = IDLE;
+        for (const auto& epoch : readerEpochs) oldestPinned = std::min(oldestPinned, epoch.load());
+        auto firstKept = std::stable_partition(retired.begin(), retired.end(),
+            [oldestPinned](const auto& entry) { return entry.first < oldestPinned; });
+        for (auto it = retired.begin(); it != firstKept; ++it) it->second();
+        retired.erase(retired.begin(), firstKept);
+    }
+
+public:
+    EpochManager() {
+        for (auto& epoch : readerEpochs) epoch.store(IDLE);
+    }
+
+    ~EpochManager() {
+        for (auto& entry : retired) entry.second();
+    }
+
+    static EpochManager& shared() {
+        static EpochManager manager;
+        return manager;
+    }
+
+    // Returns the reader slot to pass to unpin(); waits if every slot is taken
+    size_t pin() {
+        while (true) {
+            for (size_t slot = 0; slot < MAX_READERS; ++slot) {
+                uint64_t idle = IDLE;
+                if (readerEpochs[slot].compare_exchange_strong(idle, globalEpoch.load())) return slot;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    void unpin(size_t slot) { readerEpochs[slot].store(IDLE); }
+
+    // Runs `deleter` once no reader can still see the retired object
+    void retire(std::function<void()> deleter) {
+        std::lock_guard<std::mutex> guard(retiredLock);
+        retired.emplace_back(globalEpoch.fetch_add(1), std::move(deleter));
+        reclaimLocked();
+    }
+};
+
+// Keeps the calling thread pinned in the current epoch while it exists
+class EpochGuard {
+private:
+    static constexpr size_t NO_SLOT = std::numeric_limits<size_t>::max();
+    size_t slot;
+
+public:
+    EpochGuard() : slot(EpochManager::shared().pin()) {}
+    ~EpochGuard() {
+        if (slot != NO_SLOT) EpochManager::shared().unpin(slot);
+    }
+    EpochGuard(EpochGuard&& other) noexcept : slot(other.slot) { other.slot = NO_SLOT; }
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+    EpochGuard& operator=(EpochGuard&&) = delete;
+};
+
+// The ledger as a list of fixed-size segments that own the transactions.
+// Rows are only ever appended, so a published version (a row count, the
+// segments covering it and the per-kind totals at that point) never changes.
+// Readers pin a version and scan it without locks while the single writer
+// keeps appending; superseded versions are reclaimed through epochs.
+class VersionedLedger {
+public:
+    static constexpr size_t SEGMENT_ROWS = 4096;
+
+    struct Segment {
+        std::array<std::unique_ptr<Transaction>, SEGMENT_ROWS> rows;
+    };
+
+    struct Version {
+        size_t rowCount = 0;
+        std::vector<const Segment*> segments;
+        std::array<RollupCell, TRANSACTION_KIND_COUNT> totals{};
+    };
+
+    // A consistent read view: rows and totals as of one published version
+    class Snapshot {
+    private:
+        EpochGuard guard;
+        const Version* version;
+
+    public:
+        Snapshot(EpochGuard pinned, const Version* v) : guard(std::move(pinned)), version(v) {}
+
+        size_t size() const { return version->rowCount; }
+
+        const Transaction& operator[](size_t row) const {
+            return *version->segments[row / SEGMENT_ROWS]->rows[row % SEGMENT_ROWS];
+        }
+
+        const RollupCell& totals(TransactionKind kind) const { return version->totals[static_cast<size_t>(kind)]; }
+
+        template<typename Fn>
+        void forEach(Fn fn) const {
+            for (size_t row = 0; row < version->rowCount; ++row) fn((*this)[row]);
+        }
+    };
+
+private:
+    std::vector<std::unique_ptr<Segment>> segments;
+    size_t rowCount = 0;  // Appended rows, including ones not yet published
+    std::array<RollupCell, TRANSACTION_KIND_COUNT> totals{};
+    std::atomic<const Version*> current{new Version};
+
+    // Hands the segments and the published version to the epoch manager
+    void retireAll() {
+        const Version* version = current.exchange(new Version);
+        auto owned = std::make_shared<std::vector<std::unique_ptr<Segment>>>(std::move(segments));
+        EpochManager::shared().retire([version, owned] { delete version; });
+        segments.clear();
+        rowCount = 0;
+        totals = {};
+    }
+
+public:
+    VersionedLedger() = default;
+
+    ~VersionedLedger() {
+        retireAll();
+        delete current.load();
+    }
+
+    VersionedLedger(VersionedLedger&& other) noexcept { *this = std::move(other); }
+
+    VersionedLedger& operator=(VersionedLedger&& other) noexcept {
+        if (this == &other) return *this;
+        retireAll();
+        segments = std::move(other.segments);
+        rowCount = other.rowCount;
+        totals = other.totals;
+        delete current.exchange(other.current.exchange(new Version));
+        other.segments.clear();
+        other.rowCount = 0;
+        other.totals = {};
+        return *this;
+    }
+
+    // Adds a row that readers see after the next publish()
+    const Transaction* append(std::unique_ptr<Transaction> t) {
+        if (rowCount % SEGMENT_ROWS == 0) segments.push_back(std::make_unique<Segment>());
+        totals[static_cast<size_t>(t->getKind())].add(t->getAmount());
+        std::unique_ptr<Transaction>& slot = segments.back()->rows[rowCount % SEGMENT_ROWS];
+        slot = std::move(t);
+        ++rowCount;
+        return slot.get();
+    }
+
+    // Makes every appended row visible to new snapshots
+    void publish() {
+        if (current.load()->rowCount == rowCount) return;
+        Version* version = new Version;
+        version->rowCount = rowCount;
+        version->segments.reserve(segments.size());
+        for (const auto& segment : segments) version->segments.push_back(segment.get());
+        version->totals = totals;
+        const Version* old = current.exchange(version);
+        EpochManager::shared().retire([old] { delete old; });
+    }
+
+    Snapshot snapshot() const {
+        EpochGuard guard;
+        return Snapshot(std::move(guard), current.load());
+    }
+};
+
+class FinanceManager {
+private:
+    // BEFORE: Transaction* transactions[100]; (Fixed size, raw pointers, unsafe)
+    // AFTER: The versioned ledger owns the transactions; this is the writer's
+    // view of every row in order, published or not
+    VersionedLedger ledger;
+    std::vector<const Transaction*> transactions;
+    std::vector<std::unique_ptr<Investment>> investments;
+
+    // Largest expenditures, maintained incrementally for the dashboard path
+    static constexpr size_t TOP_K_CAPACITY = 10;
+    TopKTracker largestExpenditures{TOP_K_CAPACITY};
+
+    // Expenditure distributions per category and per month number
+    std::map<std::string, QuantileSketch> categorySpendSketches;
+    std::map<int, QuantileSketch> monthlySpendSketches;
+
+    // Monthly statements read these instead of scanning the ledger
+    std::map<int, MonthlyRollup> monthlyRollups;
+
+    // Trailing expenditure windows used for rolling budgets
+    RollingWindow rollingSpend;
+
+    // Amount column plus bitmaps of the rows of each kind and category
+    std::vector<double> amountColumn;
+    std::array<RowBitmap, TRANSACTION_KIND_COUNT> kindBitmaps;
+    std::unordered_map<std::string, RowBitmap> categoryBitmaps;
+
+    // Ordered by amount; updated per insert, bulk-built when a snapshot loads
+    AmountIndex amountIndex;
+
+    // Remaining query columns and per-block zone maps (min/max amount and time)
+    static constexpr size_t BLOCK_ROWS = 1024;
+    struct BlockZone {
+        double minAmount = std::numeric_limits<double>::infinity();
+        double maxAmount = -std::numeric_limits<double>::infinity();
+        std::time_t minTime = std::numeric_limits<std::time_t>::max();
+        std::time_t maxTime = std::numeric_limits<std::time_t>::min();
+    };
+    std::vector<std::time_t> timestampColumn;
+    std::vector<uint8_t> kindColumn;
+    std::vector<uint32_t> categoryColumn;
+    std::unordered_map<std::string, uint32_t> categoryIds;
+    std::vector<BlockZone> blockZones;
+
+    // Repeated queries are served from here until a matching write arrives
+    QueryCache queryCache;
+
+    // Salary, rent and other repeating entries, plus due expenditures that
+    // failed the spending checks and are retried until they pass
+    RecurringScheduler scheduler;
+    std::vector<RecurringOccurrence> deferredRecurring;
+
+    // Category budgets and the alerts raised since the caller last took them
+    BudgetEngine budgets;
+    std::vector<BudgetAlert> pendingAlerts;
+
+    // Per-category amount statistics for flagging unusual expenditures
+    AnomalyDetector anomalies;
+
+    // Transactions added since the last save, for replay after a crash, and
+    // the highest journal sequence number the ledger already holds (saved
+    // with the snapshot so replay skips what the snapshot contains)
+    std::unique_ptr<JournalWriter> journal;
+    uint64_t journaledThrough = 0;
+    bool journalReplayed = false;
+
+    // Built on first use each month, then updated per schedule change
+    CashFlowForecaster forecaster;
+
+    void updateRuleForecast(uint64_t id) {
+        if (!forecaster.isBuilt()) return;
+        auto it = scheduler.getRules().find(id);
+        if (it == scheduler.getRules().end()) forecaster.removeContribution(id);
+        else forecaster.setContribution(id, forecaster.ruleSeries(it->second));
+    }
+
+    void ensureForecast(std::time_t now) {
+        if (forecaster.isBuiltFor(monthIndex(now))) return;
+        forecaster.reset(monthIndex(now));
+        for (const auto& entry : scheduler.getRules()) updateRuleForecast(entry.first);
+    }
+
+    // Sum of maturity amounts, recomputed only after addInvestment
+    mutable bool maturityTotalValid = false;
+    mutable double maturityTotal = 0.0;
+
+    static bool isExpenditure(const Transaction& t) {
+        return t.getKind() == TransactionKind::Expenditure;
+    }
+
+    // Derived indexes that are cheap to rebuild and are not stored in snapshots.
+    // `row` is the position the transaction takes in the ledger.
+    void indexTransaction(const Transaction& t, uint32_t row) {
+        amountColumn.push_back(t.getAmount());
+        timestampColumn.push_back(t.getTimestamp());
+        kindColumn.push_back(static_cast<uint8_t>(t.getKind()));
+        auto id = categoryIds.emplace(t.getCategory(), static_cast<uint32_t>(categoryIds.size())).first;
+        categoryColumn.push_back(id->second);
+        if (row % BLOCK_ROWS == 0) blockZones.emplace_back();
+        BlockZone& zone = blockZones.back();
+        zone.minAmount = std::min(zone.minAmount, t.getAmount());
+        zone.maxAmount = std::max(zone.maxAmount, t.getAmount());
+        zone.minTime = std::min(zone.minTime, t.getTimestamp());
+        zone.maxTime = std::max(zone.maxTime, t.getTimestamp());
+        kindBitmaps[static_cast<size_t>(t.getKind())].add(row);
+        categoryBitmaps[t.getCategory()].add(row);
+        if (isExpenditure(t)) {
+            largestExpenditures.offer(&t);
+            rollingSpend.add(t.getTimestamp(), t.getAmount());
+        }
+    }
+
+    // Summaries that are persisted with snapshots
+    void summarizeTransaction(const Transaction& t) {
+        int month = monthIndex(t.getTimestamp());
+        MonthlyRollup& rollup = monthlyRollups[month];
+        if (isExpenditure(t)) {
+            QuantileSketch& categorySketch = categorySpendSketches[t.getCategory()];
+            categorySketch.add(t.getAmount());
+            anomalies.observe(t.getCategory(), t.getAmount(), categorySketch);
+            monthlySpendSketches[month].add(t.getAmount());
+            rollup.expenditure.add(t.getAmount());
+            rollup.expenditureByCategory[t.getCategory()].add(t.getAmount());
+        } else {
+            rollup.income.add(t.getAmount());
+            rollup.incomeByCategory[t.getCategory()].add(t.getAmount());
+        }
+    }
+
+    // Applies every derived structure for a new row; readers see it after publish()
+    void appendRow(std::unique_ptr<Transaction> t) {
+        indexTransaction(*t, static_cast<uint32_t>(transactions.size()));
+        amountIndex.insert(t->getAmount(), static_cast<uint32_t>(transactions.size()));
+        summarizeTransaction(*t);
+        queryCache.invalidate(*t);
+        budgets.onTransaction(*t, pendingAlerts);
+        transactions.push_back(ledger.append(std::move(t)));
+    }
+
+    static std::string formatMonth(int month) {
+        char buf[16];
+        std::snprintf(buf, sizeof(buf), "%04d-%02d", month / 12, month % 12 + 1);
+        return buf;
+    }
+
+public:
+    // Written as "FORMAT <n>" at the top of the data file. Files without the
+    // line predate it and are read as version 1.
+    static constexpr int SNAPSHOT_VERSION = 5;
+
+    // No need for counters like tcount, vector.size() handles it
+    FinanceManager() = default;
+
+    // The ledger now owns the Transaction pointer, no memory leaks!
+    // The journal write finishes in the background; failures surface
+    // through takeJournalFailures.
+    void addTransaction(std::unique_ptr<Transaction> t) {
+        OperationScope scope(Operation::AddTransaction);
+        if (journal) {
+            std::ostringstream record;
+            t->write(record);
+            journaledThrough = journal->append(record.str());
+        }
+        appendRow(std::move(t));
+        ledger.publish();
+    }
+
+    bool openJournal(const std::string& path) {
+        journal = std::make_unique<JournalWriter>(path);
+        if (!journal->isOpen()) journal.reset();
+        return journal != nullptr;
+    }
+
+    // Re-applies journaled transactions on top of a freshly loaded snapshot,
+    // skipping records the snapshot already holds
+    std::vector<const Transaction*> replayJournal() {
+        TRACE_SPAN("FinanceManager::replayJournal");
+        std::vector<const Transaction*> replayed;
+        if (!journal) return replayed;
+        journalReplayed = true;
+        for (JournalRecord& record : journal->readRecords()) {
+            if (record.sequence != 0 && record.sequence <= journaledThrough) continue;
+            journaledThrough = std::max(journaledThrough, record.sequence);
+            appendRow(std::move(record.transaction));
+            replayed.push_back(transactions.back());
+        }
+        ledger.publish();
+        return replayed;
+    }
+
+    bool truncateJournal() const { return !journal || journal->truncate(); }
+
+    // True while the journal holds records from an earlier run that were
+    // never replayed; saving then would lose them
+    bool hasUnreplayedJournal() const { return journal && journal->heldRecordsAtOpen() && !journalReplayed; }
+
+    // Journaled transactions that could not be made durable since the last call
+    uint64_t takeJournalFailures() { return journal ? journal->takeFailures() : 0; }
+
+    void displayJournalStats() const {
+        std::cout << "\n--- Journal Statistics ---\n";
+        if (!journal) {
+            std::cout << "No journal is open.\n";
+            return;
+        }
+        JournalWriter::Stats stats = journal->stats();
+        std::cout << "File: " << journal->getPath() << " (" << stats.backend << ")\n";
+        std::cout << "Records: " << stats.records << " in " << stats.batches << " batch(es), "
+                  << stats.bytes << " bytes\n";
+        if (stats.failed > 0) std::cout << "Failed: " << stats.failed << " record(s) could not be made durable\n";
+        if (stats.records == 0) return;
+        std::cout << std::fixed << std::setprecision(1)
+                  << "Throughput: " << static_cast<double>(stats.records) / std::max(stats.busySeconds, 1e-9)
+                  << " records/s while writing, " << static_cast<double>(stats.records) / static_cast<double>(stats.batches)
+                  << " records per sync\n";
+        std::cout << "Latency to durable (us): p50 " << stats.p50 << ", p99 " << stats.p99
+                  << ", p99.9 " << stats.p999 << std::endl;
+    }
+
+    // Spend windows and anomaly model behind SpendingGuard
+    const RollingWindow& getRollingSpend() const { return rollingSpend; }
+    const AnomalyDetector& getAnomalyModel() const { return anomalies; }
+
+    // Appends a batch (e.g. materialized recurring entries) in order. Not
+    // journaled: recurring entries are re-derived from their rules on reload.
+    void addTransactions(std::vector<std::unique_ptr<Transaction>> batch) {
+        transactions.reserve(transactions.size() + batch.size());
+        for (auto& t : batch) appendRow(std::move(t));
+        ledger.publish();
+    }
+
+    // Appends an imported batch: journaled as one record group, published once
+    void importBatch(std::vector<std::unique_ptr<Transaction>> batch) {
+        TRACE_SPAN("FinanceManager::importBatch");
+        if (journal) {
+            std::ostringstream records;
+            for (const auto& t : batch) t->write(records);
+            journaledThrough = journal->append(records.str());
+        }
+        transactions.reserve(transactions.size() + batch.size());
+        for (auto& t : batch) appendRow(std::move(t));
+        ledger.publish();
+    }
+
+    // A read view that stays consistent while later transactions are added
+    VersionedLedger::Snapshot readSnapshot() const { return ledger.snapshot(); }
+
+    uint64_t addRecurringRule(RecurringRule rule) {
+        uint64_t id = scheduler.addRule(std::move(rule));
+        updateRuleForecast(id);
+        return id;
+    }
+
+    // Occurrences of the rule still deferred are dropped with it
+    bool removeRecurringRule(uint64_t id) {
+        bool removed = scheduler.removeRule(id);
+        deferredRecurring.erase(std::remove_if(deferredRecurring.begin(), deferredRecurring.end(),
+                                               [id](const RecurringOccurrence& o) { return o.ruleId == id; }),
+                                deferredRecurring.end());
+        updateRuleForecast(id);
+        return removed;
+    }
+
+    const std::map<uint64_t, RecurringRule>& getRecurringRules() const { return scheduler.getRules(); }
+
+    // Recurring occurrences due by `now`; the caller decides which to apply
+    std::vector<RecurringOccurrence> collectDueRecurring(std::time_t now = std::time(nullptr)) {
+        std::vector<uint64_t> advanced;
+        std::vector<RecurringOccurrence> due = scheduler.collectDue(now, &advanced);
+        for (uint64_t id : advanced) updateRuleForecast(id);
+        return due;
+    }
+
+    // Occurrences the caller could not apply yet; they are handed back by
+    // takeDeferredRecurring, oldest first, until they are applied
+    void deferRecurring(std::vector<RecurringOccurrence> occurrences) {
+        deferredRecurring = std::move(occurrences);
+    }
+
+    std::vector<RecurringOccurrence> takeDeferredRecurring() {
+        std::vector<RecurringOccurrence> occurrences;
+        occurrences.swap(deferredRecurring);
+        return occurrences;
+    }
+
+    size_t getDeferredRecurringCount() const { return deferredRecurring.size(); }
+
+    double getDeferredRecurringTotal() const {
+        double total = 0.0;
+        for (const auto& occurrence : deferredRecurring) total += occurrence.transaction->getAmount();
+        return total;
+    }
+
+    // Month-end balances for the next 24 months, starting from `balance` now
+    // less any deferred recurring expenditures still owed
+    CashFlowForecaster::Projection forecastBalance(double balance, double minimumBalance,
+                                                   std::time_t now = std::time(nullptr)) {
+        ensureForecast(now);
+        return forecaster.project(balance, minimumBalance, getDeferredRecurringTotal());
+    }
+
+    void displayForecast(double balance, double minimumBalance) {
+        CashFlowForecaster::Projection projection = forecastBalance(balance, minimumBalance);
+        std::cout << "\n--- Balance Forecast ---\n";
+        std::cout << std::left << std::setw(10) << "Month"
+                  << std::right << std::setw(15) << "Net flow" << std::setw(18) << "Projected balance" << std::endl;
+        std::cout << std::string(43, '-') << std::endl;
+        std::cout << std::fixed << std::setprecision(2) << std::left << std::setw(10) << "Now"
+                  << std::right << std::setw(33) << projection.opening << std::endl;
+        if (projection.owed > 0.0) {
+            std::cout << std::left << std::setw(10) << "Deferred" << std::right << std::setw(15) << -projection.owed
+                      << std::setw(18) << projection.opening - projection.owed << std::endl;
+        }
+        for (int m = 0; m < CashFlowForecaster::HORIZON; ++m) {
+            std::cout << std::left << std::setw(10) << formatMonth(projection.firstMonth + m)
+                      << std::right << std::fixed << std::setprecision(2)
+                      << std::setw(15) << projection.net[m] << std::setw(18) << projection.balance[m]
+                      << (m == projection.firstDip ? "  <-- below minimum" : "") << std::endl;
+        }
+        if (projection.firstDip >= 0) {
+            std::cout << "Warning: balance is projected to fall below " << minimumBalance << " INR in "
+                      << formatMonth(projection.firstMonth + projection.firstDip) << ".\n";
+        }
+    }
+
+    void displayRecurringRules() const {
+        std::cout << "\n--- Recurring Rules ---\n";
+        std::cout << std::left << std::setw(5) << "Id" << std::setw(13) << "Type"
+                  << std::right << std::setw(10) << "Amount" << "  " << std::left << std::setw(12) << "Every"
+                  << std::setw(12) << "Next due" << std::setw(15) << "Category" << "Description" << std::endl;
+        std::cout << std::string(80, '-') << std::endl;
+        for (const auto& entry : scheduler.getRules()) {
+            const RecurringRule& rule = entry.second;
+            std::string every = std::to_string(rule.interval) + (rule.unit == RecurringRule::Unit::Days ? " day(s)" : " month(s)");
+            std::cout << std::left << std::setw(5) << rule.id
+                      << std::setw(13) << (rule.kind == TransactionKind::Income ? "Income" : "Expenditure")
+                      << std::right << std::setw(10) << std::fixed << std::setprecision(2) << rule.amount << "  "
+                      << std::left << std::setw(12) << every << std::setw(12) << formatDate(rule.nextDue)
+                      << std::setw(15) << rule.category << rule.description << std::endl;
+        }
+        if (deferredRecurring.empty()) return;
+        std::cout << "\nDeferred (retried until the balance and spend limits allow them, or skipped once the\n"
+                  << "rule's next occurrence is due):\n";
+        for (const auto& occurrence : deferredRecurring) {
+            const Transaction& t = *occurrence.transaction;
+            std::cout << "  " << formatDate(t.getTimestamp()) << "  " << std::right << std::setw(10) << std::fixed
+                      << std::setprecision(2) << t.getAmount() << "  " << std::left << std::setw(15) << t.getCategory()
+                      << t.getDescription() << std::endl;
+        }
+    }
+
+    // A new budget starts from the spending already recorded in its current
+    // period: the month's rollup, or a ledger query for the week
+    uint64_t addBudget(Budget budget, std::time_t now = std::time(nullptr)) {
+        double spent = 0.0;
+        if (budget.period == Budget::Period::Monthly) {
+            auto month = monthlyRollups.find(monthIndex(now));
+            if (month != monthlyRollups.end()) {
+                if (budget.category.empty()) {
+                    spent = month->second.expenditure.total;
+                } else {
+                    auto cell = month->second.expenditureByCategory.find(budget.category);
+                    if (cell != month->second.expenditureByCategory.end()) spent = cell->second.total;
+                }
+            }
+        } else {
+            Query week;
+            week.aggregate = Query::Aggregate::Sum;
+            week.kind = static_cast<int>(TransactionKind::Expenditure);
+            week.hasCategory = !budget.category.empty();
+            week.category = budget.category;
+            week.from = static_cast<std::time_t>((budget.periodOf(now) * 7 - 3) * 86400L);  // Monday
+            week.to = week.from + 7 * 86400L - 1;
+            spent = runQuery(week).value;
+        }
+        uint64_t id = budgets.addBudget(std::move(budget));
+        budgets.seed(id, now, spent, pendingAlerts);
+        return id;
+    }
+
+    const std::map<uint64_t, Budget>& getBudgets() const { return budgets.getBudgets(); }
+    bool removeBudget(uint64_t id) { return budgets.removeBudget(id); }
+
+    // Budget alerts raised by transactions added since the last call
+    std::vector<BudgetAlert> takeBudgetAlerts() {
+        std::vector<BudgetAlert> alerts;
+        alerts.swap(pendingAlerts);
+        return alerts;
+    }
+
+    void displayBudgets() const {
+        std::cout << "\n--- Budgets ---\n";
+        std::cout << std::left << std::setw(5) << "Id" << std::setw(15) << "Category" << std::setw(10) << "Period"
+                  << std::right << std::setw(12) << "Limit" << std::setw(12) << "Spent" << std::setw(8) << "Used" << std::endl;
+        std::cout << std::string(62, '-') << std::endl;
+        std::time_t now = std::time(nullptr);
+        for (const auto& entry : budgets.getBudgets()) {
+            const Budget& b = entry.second;
+            double spent = b.currentPeriod == b.periodOf(now) ? b.spent : 0.0;
+            std::cout << std::left << std::setw(5) << b.id << std::setw(15) << (b.category.empty() ? "(all)" : b.category)
+                      << std::setw(10) << (b.period == Budget::Period::Weekly ? "Weekly" : "Monthly")
+                      << std::right << std::fixed << std::setprecision(2) << std::setw(12) << b.limit
+                      << std::setw(12) << spent << std::setw(7) << std::setprecision(0)
+                      << (b.limit > 0.0 ? spent / b.limit * 100.0 : 0.0) << "%" << std::endl;
+        }
+    }
+
+    void addInvestment(std::unique_ptr<Investment> i) {
+        OperationScope scope(Operation::AddInvestment);
+        investments.push_back(std::move(i));
+        maturityTotalValid = false;
+    }
+
+    double getTotalMaturityAmount() const {
+        if (!maturityTotalValid) {
+            std::vector<double> amounts;
+            amounts.reserve(investments.size());
+            for (const auto& inv : investments) amounts.push_back(inv->getMaturityAmount());
+            maturityTotal = DeterministicSum::sum(amounts);
+            maturityTotalValid = true;
+        }
+        return maturityTotal;
+    }
+
+    void displayTransactionHistory() const {
+        OperationScope scope(Operation::TransactionHistory);
+        // Rows and totals come from the same version, even if rows are added
+        // meanwhile. The report is formatted in memory first so the trace
+        // separates the ledger scan from the terminal write.
+        std::ostringstream report;
+        report << std::fixed << std::setprecision(2);
+        {
+            TRACE_SPAN("transactionHistory.scan");
+            VersionedLedger::Snapshot snapshot = readSnapshot();
+            report << "\n--- Transaction History ---\n";
+            report << std::left << std::setw(15) << "Type"
+                   << std::right << std::setw(10) << "Amount"
+                   << "    " << std::left << std::setw(12) << "Date"
+                   << std::setw(15) << "Category" << "Description" << std::endl;
+            report << std::string(70, '-') << std::endl;
+            snapshot.forEach([&report](const Transaction& t) { t.display(report); });
+            report << std::string(70, '-') << std::endl;
+            report << "Total income: " << snapshot.totals(TransactionKind::Income).total
+                   << " INR, total expenditure: " << snapshot.totals(TransactionKind::Expenditure).total << " INR" << std::endl;
+        }
+        TRACE_SPAN("transactionHistory.write");
+        std::cout << report.str() << std::flush;
+    }
+
+    void displayInvestmentPortfolio() const {
+        OperationScope scope(Operation::InvestmentPortfolio);
+        std::ostringstream report;
+        report << std::fixed << std::setprecision(2);
+        {
+            TRACE_SPAN("investmentPortfolio.scan");
+            report << "\n--- Investment Portfolio ---\n";
+            report << std::left << std::setw(15) << "Type"
+                   << std::right << std::setw(10) << "Principal"
+                   << std::setw(15) << "Duration"
+                   << "  Details" << std::endl;
+            report << std::string(70, '-') << std::endl;
+            for (const auto& i : investments) {
+                i->display(report);
+            }
+        }
+        TRACE_SPAN("investmentPortfolio.write");
+        std::cout << report.str() << std::flush;
+    }
+
+    PortfolioColumns getPortfolioColumns() const {
+        PortfolioColumns columns;
+        for (const auto& inv : investments) {
+            const SIP* sip = dynamic_cast<const SIP*>(inv.get());
+            columns.principal.push_back(inv->getPrincipal());
+            columns.monthly.push_back(sip ? sip->getMonthlyInvestment() : 0.0);
+            columns.isSip.push_back(sip ? 1.0 : 0.0);
+        }
+        return columns;
+    }
+
+    // Maturity value of every holding at every grid point
+    ScenarioTensor sweepPortfolioScenarios(const ScenarioGrid& grid) const {
+        return sweepScenarios(getPortfolioColumns(), grid);
+    }
+
+    // Total portfolio value, one row per rate and one column per duration
+    void displayScenarioGrid(const ScenarioGrid& grid) const {
+        ScenarioTensor tensor = sweepPortfolioScenarios(grid);
+        std::cout << "\n--- What-if: Portfolio Value at Maturity ---\n";
+        std::cout << std::left << std::setw(10) << "Rate %";
+        for (int years : grid.durations) std::cout << std::right << std::setw(14) << (std::to_string(years) + " yrs");
+        std::cout << std::endl << std::string(10 + 14 * grid.durations.size(), '-') << std::endl;
+        for (size_t r = 0; r < tensor.rateCount; ++r) {
+            std::cout << std::left << std::setw(10) << std::fixed << std::setprecision(2) << grid.rates[r] * 100.0;
+            for (size_t d = 0; d < tensor.durationCount; ++d) {
+                double total = DeterministicSum::sum(&tensor.values[(r * tensor.durationCount + d) * tensor.monthlyCount
+                                                                    * tensor.investmentCount], tensor.investmentCount);
+                std::cout << std::right << std::setw(14) << total;
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    // Mark-to-market value of every SIP that tracks a fund, evaluated in
+    // parallel across holdings. Results line up with getInvestments().
+    std::vector<SipValuation> valueSipsAtMarket(NavStore& navStore, std::time_t asOf = std::time(nullptr)) const {
+        std::vector<const NavSeries*> navs(investments.size(), nullptr);
+        std::vector<SipValuation> results(investments.size());
+        for (size_t i = 0; i < investments.size(); ++i) {
+            const SIP* sip = dynamic_cast<const SIP*>(investments[i].get());
+            if (!sip) results[i].status = "not a SIP";
+            else if (sip->getFundCode().empty()) results[i].status = "no fund code";
+            else if (!(navs[i] = navStore.get(sip->getFundCode()))) results[i].status = "no NAV history";
+        }
+        parallelFor(investments.size(), 64, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                if (navs[i]) results[i] = valueSip(static_cast<const SIP&>(*investments[i]), *navs[i], asOf);
+            }
+        });
+        return results;
+    }
+
+    void displayMarketValuation(NavStore& navStore) const {
+        std::cout << "\n--- Mark-to-Market SIP Valuation ---\n";
+        std::cout << std::left << std::setw(6) << "Item" << std::setw(12) << "Fund"
+                  << std::right << std::setw(8) << "Months" << std::setw(14) << "Invested"
+                  << std::setw(14) << "Units" << std::setw(14) << "Value" << "  Status" << std::endl;
+        std::cout << std::string(80, '-') << std::endl;
+        std::vector<SipValuation> results = valueSipsAtMarket(navStore);
+        for (size_t i = 0; i < results.size(); ++i) {
+            const SIP* sip = dynamic_cast<const SIP*>(investments[i].get());
+            if (!sip) continue;
+            const SipValuation& v = results[i];
+            std::cout << std::left << std::setw(6) << i + 1 << std::setw(12) << (sip->getFundCode().empty() ? "-" : sip->getFundCode())
+                      << std::right << std::setw(8) << v.installments << std::fixed << std::setprecision(2)
+                      << std::setw(14) << v.invested << std::setprecision(4) << std::setw(14) << v.units
+                      << std::setprecision(2) << std::setw(14) << v.currentValue << "  " << v.status << std::endl;
+        }
+    }
+
+    // XIRR of every investment, solved as one batch. SIPs with NAV history use
+    // their purchases to date and today's market value; everything else uses
+    // its scheduled flows and fixed-rate maturity. `marketBased` marks the former.
+    std::vector<XirrResult> computePortfolioXirr(NavStore& navStore, std::vector<bool>& marketBased,
+                                                 std::time_t asOf = std::time(nullptr)) const {
+        std::vector<SipValuation> valuations = valueSipsAtMarket(navStore, asOf);
+        std::vector<std::vector<CashFlow>> schedules;
+        schedules.reserve(investments.size());
+        marketBased.assign(investments.size(), false);
+        for (size_t i = 0; i < investments.size(); ++i) {
+            const SIP* sip = dynamic_cast<const SIP*>(investments[i].get());
+            std::vector<CashFlow> flows;
+            if (sip) flows = sipMarketCashFlows(*sip, valuations[i], asOf);
+            marketBased[i] = !flows.empty();
+            schedules.push_back(flows.empty() ? investments[i]->getCashFlows() : std::move(flows));
+        }
+        return XirrSolver::solveBatch(schedules);
+    }
+
+    void displayPortfolioXirr(NavStore& navStore) const {
+        std::cout << "\n--- Portfolio XIRR ---\n";
+        std::cout << std::left << std::setw(6) << "Item" << std::setw(15) << "Type" << std::setw(12) << "Basis"
+                  << std::right << std::setw(12) << "XIRR %" << std::setw(12) << "Iterations"
+                  << "  Status" << std::endl;
+        std::cout << std::string(80, '-') << std::endl;
+        std::vector<bool> marketBased;
+        std::vector<XirrResult> results = computePortfolioXirr(navStore, marketBased);
+        for (size_t i = 0; i < results.size(); ++i) {
+            std::cout << std::left << std::setw(6) << i + 1 << std::setw(15) << investments[i]->getType()
+                      << std::setw(12) << (marketBased[i] ? "NAV" : "fixed rate")
+                      << std::right << std::setw(12) << std::fixed << std::setprecision(3) << results[i].rate * 100.0
+                      << std::setw(12) << results[i].iterations << "  " << results[i].status << std::endl;
+        }
+    }
+
+    void displayInvestmentProjections() const {
+        OperationScope scope(Operation::InvestmentProjections);
+        std::ostringstream report;
+        report << std::fixed << std::setprecision(2);
+        {
+            TRACE_SPAN("investmentProjections.scan");
+            report << "\n--- Investment Maturity Projections ---\n";
+            for (size_t i = 0; i < investments.size(); ++i) {
+                const auto& inv = investments[i];
+                report << "Portfolio Item " << i + 1 << " (" << inv->getType() << "):\n";
+                report << "  Matures to: " << inv->getMaturityAmount() << " INR" << std::endl;
+            }
+            if (!investments.empty()) {
+                report << "Total at maturity: " << getTotalMaturityAmount() << " INR" << std::endl;
+            }
+        }
+        TRACE_SPAN("investmentProjections.write");
+        std::cout << report.str() << std::flush;
+    }
+    
+    // The k largest expenditures, optionally restricted to [from, to] and a category
+    // (empty category means all). Unfiltered requests within the tracker's capacity
+    // are answered from the maintained top-K; everything else uses a bounded heap scan.
+    std::vector<const Transaction*> topExpenditures(size_t k,
+                                                    std::time_t from = std::numeric_limits<std::time_t>::min(),
+                                                    std::time_t to = std::numeric_limits<std::time_t>::max(),
+                                                    const std::string& category = "") const {
+        bool unfiltered = from == std::numeric_limits<std::time_t>::min()
+                       && to == std::numeric_limits<std::time_t>::max() && category.empty();
+        if (unfiltered && k <= largestExpenditures.getCapacity()) {
+            const auto& items = largestExpenditures.getItems();
+            return std::vector<const Transaction*>(items.begin(), items.begin() + std::min(k, items.size()));
+        }
+
+        using Entry = std::pair<double, const Transaction*>;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;  // min-heap of size <= k
+        for (const auto& t : transactions) {
+            if (!isExpenditure(*t)) continue;
+            if (t->getTimestamp() < from || t->getTimestamp() > to) continue;
+            if (!category.empty() && t->getCategory() != category) continue;
+            if (heap.size() < k) {
+                heap.emplace(t->getAmount(), t);
+            } else if (k > 0 && t->getAmount() > heap.top().first) {
+                heap.pop();
+                heap.emplace(t->getAmount(), t);
+            }
+        }
+        std::vector<const Transaction*> result(heap.size());
+        for (size_t i = result.size(); i > 0; --i) {
+            result[i - 1] = heap.top().second;
+            heap.pop();
+        }
+        return result;
+    }
+
+    // The k payees (expenditure descriptions) with the largest total spend
+    std::vector<std::pair<std::string, double>> topPayees(size_t k) const {
+        std::unordered_map<std::string, double> totals;
+        for (const auto& t : transactions) {
+            if (isExpenditure(*t)) totals[t->getDescription()] += t->getAmount();
+        }
+
+        using Entry = std::pair<double, const std::string*>;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+        for (const auto& p : totals) {
+            if (heap.size() < k) {
+                heap.emplace(p.second, &p.first);
+            } else if (k > 0 && p.second > heap.top().first) {
+                heap.pop();
+                heap.emplace(p.second, &p.first);
+            }
+        }
+        std::vector<std::pair<std::string, double>> result(heap.size());
+        for (size_t i = result.size(); i > 0; --i) {
+            result[i - 1] = {*heap.top().second, heap.top().first};
+            heap.pop();
+        }
+        return result;
+    }
+
+    void displayTopExpenditures(size_t k, const std::string& category) const {
+        std::cout << "\n--- Top " << k << " Expenditures";
+        if (!category.empty()) std::cout << " (" << category << ")";
+        std::cout << " ---\n";
+        std::cout << std::left << std::setw(15) << "Type"
+                  << std::right << std::setw(10) << "Amount"
+                  << "    " << std::left << std::setw(12) << "Date"
+                  << std::setw(15) << "Category" << "Description" << std::endl;
+        std::cout << std::string(70, '-') << std::endl;
+        for (const auto* t : topExpenditures(k, std::numeric_limits<std::time_t>::min(),
+                                             std::numeric_limits<std::time_t>::max(), category)) {
+            t->display();
+        }
+    }
+
+    void displayTopPayees(size_t k) const {
+        std::cout << "\n--- Top " << k << " Payees ---\n";
+        std::cout << std::left << std::setw(30) << "Payee"
+                  << std::right << std::setw(15) << "Total Spent" << std::endl;
+        std::cout << std::string(45, '-') << std::endl;
+        for (const auto& p : topPayees(k)) {
+            std::cout << std::left << std::setw(30) << p.first
+                      << std::right << std::setw(15) << std::fixed << std::setprecision(2) << p.second << std::endl;
+        }
+    }
+
+    // Approximate q-quantile of expenditure amounts in one category (NaN if none)
+    double expenditureQuantile(const std::string& category, double q) const {
+        auto it = categorySpendSketches.find(category);
+        return it == categorySpendSketches.end() ? std::numeric_limits<double>::quiet_NaN() : it->second.quantile(q);
+    }
+
+    // Approximate q-quantile of expenditure amounts in one month number (NaN if none)
+    double monthlyExpenditureQuantile(int month, double q) const {
+        auto it = monthlySpendSketches.find(month);
+        return it == monthlySpendSketches.end() ? std::numeric_limits<double>::quiet_NaN() : it->second.quantile(q);
+    }
+
+    void displaySpendingDistribution() const {
+        std::cout << "\n--- Spending Distribution by Category ---\n";
+        std::cout << std::left << std::setw(15) << "Category"
+                  << std::right << std::setw(10) << "Count"
+                  << std::setw(15) << "Median" << std::setw(15) << "p95" << std::endl;
+        std::cout << std::string(55, '-') << std::endl;
+        QuantileSketch overall;
+        for (const auto& entry : categorySpendSketches) {
+            const auto& sketch = entry.second;
+            overall.merge(sketch);
+            std::cout << std::left << std::setw(15) << entry.first
+                      << std::right << std::setw(10) << sketch.getCount()
+                      << std::fixed << std::setprecision(2)
+                      << std::setw(15) << sketch.quantile(0.5) << std::setw(15) << sketch.quantile(0.95) << std::endl;
+        }
+        if (overall.getCount() > 0) {
+            std::cout << std::left << std::setw(15) << "All"
+                      << std::right << std::setw(10) << overall.getCount()
+                      << std::fixed << std::setprecision(2)
+                      << std::setw(15) << overall.quantile(0.5) << std::setw(15) << overall.quantile(0.95) << std::endl;
+        }
+    }
+
+    const RowBitmap& rowsOfKind(TransactionKind kind) const {
+        return kindBitmaps[static_cast<size_t>(kind)];
+    }
+
+    // Rows in a category; an empty bitmap for unknown categories
+    const RowBitmap& rowsInCategory(const std::string& category) const {
+        static const RowBitmap empty;
+        auto it = categoryBitmaps.find(category);
+        return it == categoryBitmaps.end() ? empty : it->second;
+    }
+
+    // Count and total of the selected rows, read from the amount column
+    RollupCell sumRows(const RowBitmap& rows) const {
+        std::vector<double> selected;
+        selected.reserve(rows.cardinality());
+        rows.forEach([&](uint32_t row) { selected.push_back(amountColumn[row]); });
+        RollupCell result;
+        result.count = selected.size();
+        result.total = DeterministicSum::sum(selected);
+        return result;
+    }
+
+    double totalOf(TransactionKind kind) const {
+        return sumRows(rowsOfKind(kind)).total;
+    }
+
+    // Totals for one kind (or both when kind is null) across the included
+    // categories (all when empty), minus the excluded categories
+    RollupCell filterTotals(const TransactionKind* kind, const std::vector<std::string>& include,
+                            const std::vector<std::string>& exclude) const {
+        RowBitmap rows;
+        if (kind) {
+            rows = rowsOfKind(*kind);
+        } else {
+            rows = rowsOfKind(TransactionKind::Income) | rowsOfKind(TransactionKind::Expenditure);
+        }
+        if (!include.empty()) {
+            RowBitmap selected;
+            for (const auto& category : include) selected = selected | rowsInCategory(category);
+            rows = rows & selected;
+        }
+        for (const auto& category : exclude) rows = rows.andNot(rowsInCategory(category));
+        return sumRows(rows);
+    }
+
+    // Evaluates a parsed query against the columns. Amount and date bounds are
+    // checked against each block's zone map first so non-overlapping blocks are
+    // skipped; the cheap column predicates run before the description match.
+    QueryResult runQuery(const Query& query) const {
+        OperationScope scope(Operation::RunQuery);
+        QueryResult result;
+        result.aggregate = query.aggregate;
+
+        uint32_t categoryId = std::numeric_limits<uint32_t>::max();
+        if (query.hasCategory) {
+            auto it = categoryIds.find(query.category);
+            if (it == categoryIds.end()) return result;
+            categoryId = it->second;
+        }
+        const bool anyKind = query.kind < 0;
+        const uint8_t kind = static_cast<uint8_t>(query.kind);
+
+        std::vector<uint32_t> matches;
+        for (size_t block = 0; block < blockZones.size(); ++block) {
+            const BlockZone& zone = blockZones[block];
+            if (zone.maxAmount < query.minAmount || zone.minAmount > query.maxAmount
+                || zone.maxTime < query.from || zone.minTime > query.to) {
+                ++result.blocksSkipped;
+                continue;
+            }
+            ++result.blocksScanned;
+            size_t end = std::min(amountColumn.size(), (block + 1) * BLOCK_ROWS);
+            for (size_t row = block * BLOCK_ROWS; row < end; ++row) {
+                double amount = amountColumn[row];
+                std::time_t when = timestampColumn[row];
+                if (amount < query.minAmount || amount > query.maxAmount) continue;
+                if (when < query.from || when > query.to) continue;
+                if (!anyKind && kindColumn[row] != kind) continue;
+                if (query.hasCategory && categoryColumn[row] != categoryId) continue;
+                if (!query.descriptionMatch.empty()
+                    && toLower(transactions[row]->getDescription()).find(query.descriptionMatch) == std::string::npos) {
+                    continue;
+                }
+                matches.push_back(static_cast<uint32_t>(row));
+            }
+        }
+
+        if (query.orderBy != Query::OrderBy::None) {
+            auto key = [&](uint32_t row) {
+                return query.orderBy == Query::OrderBy::Amount ? amountColumn[row] : static_cast<double>(timestampColumn[row]);
+            };
+            std::stable_sort(matches.begin(), matches.end(), [&](uint32_t a, uint32_t b) {
+                return query.descending ? key(a) > key(b) : key(a) < key(b);
+            });
+        }
+        result.count = matches.size();
+        switch (query.aggregate) {
+            case Query::Aggregate::List:
+                if (query.limit > 0 && matches.size() > query.limit) matches.resize(query.limit);
+                result.count = matches.size();
+                result.rows = std::move(matches);
+                break;
+            case Query::Aggregate::Count: result.value = static_cast<double>(result.count); break;
+            case Query::Aggregate::Sum:
+            case Query::Aggregate::Avg: {
+                std::vector<double> selected;
+                selected.reserve(matches.size());
+                for (uint32_t row : matches) selected.push_back(amountColumn[row]);
+                double total = DeterministicSum::sum(selected);
+                result.value = query.aggregate == Query::Aggregate::Sum || matches.empty()
+                             ? total : total / static_cast<double>(matches.size());
+                break;
+            }
+            case Query::Aggregate::Min:
+            case Query::Aggregate::Max: {
+                for (size_t i = 0; i < matches.size(); ++i) {
+                    double amount = amountColumn[matches[i]];
+                    bool better = query.aggregate == Query::Aggregate::Min ? amount < result.value : amount > result.value;
+                    if (i == 0 || better) result.value = amount;
+                }
+                break;
+            }
+        }
+        return result;
+    }
+
+    // runQuery through the result cache
+    const QueryResult& runCachedQuery(const Query& query) {
+        std::string key = query.normalized();
+        if (const QueryResult* cached = queryCache.find(key)) return *cached;
+        return queryCache.store(key, query, runQuery(query));
+    }
+
+    const QueryCache& getQueryCache() const { return queryCache; }
+
+    void displayQueryResult(const QueryResult& result) const {
+        TRACE_SPAN("FinanceManager::displayQueryResult");
+        std::cout << "\n--- Query Result ---\n";
+        if (result.aggregate == Query::Aggregate::List) {
+            std::cout << std::left << std::setw(15) << "Type"
+                      << std::right << std::setw(10) << "Amount"
+                      << "    " << std::left << std::setw(12) << "Date"
+                      << std::setw(15) << "Category" << "Description" << std::endl;
+            std::cout << std::string(70, '-') << std::endl;
+            for (uint32_t row : result.rows) transactions[row]->display();
+            std::cout << result.rows.size() << " row(s)";
+        } else if (result.aggregate == Query::Aggregate::Count) {
+            std::cout << "Count: " << result.count;
+        } else {
+            std::cout << "Result: " << std::fixed << std::setprecision(2) << result.value
+                      << " INR over " << result.count << " row(s)";
+        }
+        std::cout << " [blocks scanned " << result.blocksScanned << ", skipped " << result.blocksSkipped << "]\n";
+    }
+
+    // Number of transactions with lo <= amount <= hi
+    size_t countInAmountRange(double lo, double hi) const {
+        return amountIndex.count(lo, hi);
+    }
+
+    // Transactions with lo <= amount <= hi, smallest first
+    std::vector<const Transaction*> transactionsInAmountRange(double lo, double hi) const {
+        std::vector<const Transaction*> result;
+        for (const auto& entry : amountIndex.range(lo, hi)) result.push_back(transactions[entry.second]);
+        return result;
+    }
+
+    void displayAmountRange(double lo, double hi) const {
+        std::cout << "\n--- Transactions Between " << std::fixed << std::setprecision(2) << lo
+                  << " and " << hi << " INR ---\n";
+        std::cout << "Count: " << countInAmountRange(lo, hi) << std::endl;
+        std::cout << std::left << std::setw(15) << "Type"
+                  << std::right << std::setw(10) << "Amount"
+                  << "    " << std::left << std::setw(12) << "Date"
+                  << std::setw(15) << "Category" << "Description" << std::endl;
+        std::cout << std::string(70, '-') << std::endl;
+        for (const auto* t : transactionsInAmountRange(lo, hi)) t->display();
+    }
+
+    // Expenditure count and total in the trailing window (index into RollingWindow::WINDOW_DAYS)
+    RollupCell trailingSpend(size_t window, std::time_t now = std::time(nullptr)) const {
+        return rollingSpend.trailing(window, now);
+    }
+
+    void displayRollingSpend() const {
+        std::cout << "\n--- Rolling Spend ---\n";
+        std::cout << std::left << std::setw(15) << "Window"
+                  << std::right << std::setw(10) << "Count" << std::setw(15) << "Total" << std::endl;
+        std::cout << std::string(40, '-') << std::endl;
+        for (size_t w = 0; w < RollingWindow::WINDOW_COUNT; ++w) {
+            RollupCell cell = trailingSpend(w);
+            std::cout << std::left << std::setw(15) << ("Last " + std::to_string(RollingWindow::WINDOW_DAYS[w]) + " days")
+                      << std::right << std::setw(10) << cell.count
+                      << std::setw(15) << std::fixed << std::setprecision(2) << cell.total << std::endl;
+        }
+    }
+
+    // Per-month income, expenditure and net for the most recent months
+    // (0 means all), read entirely from the materialized rollups
+    void displayMonthlyStatement(size_t recentMonths) const {
+        std::cout << "\n--- Monthly Statement ---\n";
+        std::cout << std::left << std::setw(10) << "Month"
+                  << std::right << std::setw(15) << "Income"
+                  << std::setw(15) << "Expenditure" << std::setw(15) << "Net"
+                  << "  Top spend category" << std::endl;
+        std::cout << std::string(75, '-') << std::endl;
+        auto it = monthlyRollups.begin();
+        if (recentMonths > 0 && monthlyRollups.size() > recentMonths) {
+            std::advance(it, monthlyRollups.size() - recentMonths);
+        }
+        for (; it != monthlyRollups.end(); ++it) {
+            const MonthlyRollup& rollup = it->second;
+            auto top = std::max_element(rollup.expenditureByCategory.begin(), rollup.expenditureByCategory.end(),
+                [](const auto& a, const auto& b) { return a.second.total < b.second.total; });
+            std::cout << std::left << std::setw(10) << formatMonth(it->first)
+                      << std::right << std::fixed << std::setprecision(2)
+                      << std::setw(15) << rollup.income.total
+                      << std::setw(15) << rollup.expenditure.total
+                      << std::setw(15) << rollup.income.total - rollup.expenditure.total
+                      << "  " << (top == rollup.expenditureByCategory.end() ? "-" : top->first) << std::endl;
+        }
+    }
+
+    // Writes the ledger and its persisted summaries as text sections
+    void saveSnapshot(std::ostream& out) const {
+        TRACE_SPAN("FinanceManager::saveSnapshot");
+        out << "TRANSACTIONS " << transactions.size() << '\n';
+        for (const auto& t : transactions) t->write(out);
+        out << "INVESTMENTS " << investments.size() << '\n';
+        for (const auto& i : investments) i->write(out);
+        out << "CATEGORY_SKETCHES " << categorySpendSketches.size() << '\n';
+        for (const auto& entry : categorySpendSketches) {
+            out << entry.first << '\t';
+            entry.second.write(out);
+            out << '\n';
+        }
+        out << "MONTH_SKETCHES " << monthlySpendSketches.size() << '\n';
+        for (const auto& entry : monthlySpendSketches) {
+            out << entry.first << ' ';
+            entry.second.write(out);
+            out << '\n';
+        }
+        size_t cells = 0;
+        for (const auto& entry : monthlyRollups) {
+            cells += entry.second.incomeByCategory.size() + entry.second.expenditureByCategory.size();
+        }
+        out << "ROLLUPS " << cells << '\n';
+        for (const auto& entry : monthlyRollups) {
+            for (const auto& cell : entry.second.incomeByCategory) {
+                out << entry.first << "\tIncome\t" << cell.first << '\t' << cell.second.count << '\t' << cell.second.total << '\n';
+            }
+            for (const auto& cell : entry.second.expenditureByCategory) {
+                out << entry.first << "\tExpenditure\t" << cell.first << '\t' << cell.second.count << '\t' << cell.second.total << '\n';
+            }
+        }
+        scheduler.write(out);
+        out << "DEFERRED " << deferredRecurring.size() << '\n';
+        for (const auto& occurrence : deferredRecurring) {
+            out << occurrence.ruleId << '\t';
+            occurrence.transaction->write(out);
+        }
+        budgets.write(out);
+        anomalies.write(out);
+        out << "JOURNALED " << journaledThrough << '\n';
+    }
+
+    // Name of the next snapshot section without consuming it; empty at the end
+    static std::string peekSection(std::istream& in) {
+        std::streampos mark = in.tellg();
+        std::string section;
+        if (!(in >> section)) {
+            in.clear();
+            return "";
+        }
+        in.seekg(mark);
+        return section;
+    }
+
+    // Replaces the current state with a snapshot in the given format version.
+    // Leaves this manager untouched and returns false if it is malformed.
+    bool loadSnapshot(std::istream& in, int version) {
+        TRACE_SPAN("FinanceManager::loadSnapshot");
+        FinanceManager loaded;
+        std::string section, line;
+        size_t n = 0;
+
+        if (!(in >> section >> n) || section != "TRANSACTIONS") return false;
+        std::getline(in, line);
+        for (size_t i = 0; i < n; ++i) {
+            if (!std::getline(in, line)) return false;
+            std::unique_ptr<Transaction> t = parseTransaction(line);
+            if (!t) return false;
+            loaded.indexTransaction(*t, static_cast<uint32_t>(loaded.transactions.size()));
+            loaded.transactions.push_back(loaded.ledger.append(std::move(t)));
+        }
+        loaded.ledger.publish();
+        loaded.amountIndex = AmountIndex::build(loaded.amountColumn);
+
+        if (!(in >> section >> n) || section != "INVESTMENTS") return false;
+        std::getline(in, line);
+        for (size_t i = 0; i < n; ++i) {
+            if (!std::getline(in, line)) return false;
+            std::istringstream fields(line);
+            std::string kind;
+            double principalAmt = 0.0;
+            int dur = 0;
+            long long start = 0;
+            if (!(fields >> kind >> principalAmt >> dur)) return false;
+            if (kind == "SIP") {
+                double monthly = 0.0;
+                std::string fund = "-";
+                if (!(fields >> monthly >> start)) return false;
+                // Version 1 SIP lines may predate fund codes
+                if (!(fields >> fund) && version >= 2) return false;
+                if (fund != "-" && !isValidFundCode(fund)) return false;
+                loaded.investments.push_back(std::make_unique<SIP>(principalAmt, dur, monthly, static_cast<std::time_t>(start),
+                                                                   fund == "-" ? "" : fund));
+            } else if (kind == "FD") {
+                if (!(fields >> start)) return false;
+                loaded.investments.push_back(std::make_unique<FD>(principalAmt, dur, static_cast<std::time_t>(start)));
+            } else {
+                return false;
+            }
+        }
+
+        if (!(in >> section >> n) || section != "CATEGORY_SKETCHES") return false;
+        std::getline(in, line);
+        for (size_t i = 0; i < n; ++i) {
+            std::string category;
+            if (!std::getline(in, category, '\t') || !loaded.categorySpendSketches[category].read(in)) return false;
+            std::getline(in, line);
+        }
+        if (!(in >> section >> n) || section != "MONTH_SKETCHES") return false;
+        for (size_t i = 0; i < n; ++i) {
+            int month = 0;
+            if (!(in >> month) || !loaded.monthlySpendSketches[month].read(in)) return false;
+        }
 
-public:
-    // Use explicit to prevent accidental type conversions
-    explicit Transaction(double amt, std::string des) 
-        : amount(amt), description(std::move(des)) {}
+        // Kind totals are derived from the per-category cells
+        if (!(in >> section >> n) || section != "ROLLUPS") return false;
+        std::getline(in, line);
+        for (size_t i = 0; i < n; ++i) {
+            if (!std::getline(in, line)) return false;
+            std::istringstream fields(line);
+            std::string monthText, kind, category, countText, totalText;
+            if (!std::getline(fields, monthText, '\t') || !std::getline(fields, kind, '\t')
+                || !std::getline(fields, category, '\t') || !std::getline(fields, countText, '\t')
+                || !std::getline(fields, totalText)) {
+                return false;
+            }
+            RollupCell cell;
+            cell.count = std::strtoull(countText.c_str(), nullptr, 10);
+            cell.total = std::strtod(totalText.c_str(), nullptr);
+            MonthlyRollup& rollup = loaded.monthlyRollups[std::atoi(monthText.c_str())];
+            RollupCell& kindTotal = kind == "Income" ? rollup.income : rollup.expenditure;
+            if (kind == "Income") rollup.incomeByCategory[category] = cell;
+            else if (kind == "Expenditure") rollup.expenditureByCategory[category] = cell;
+            else return false;
+            kindTotal.count += cell.count;
+            kindTotal.total += cell.total;
+        }
 
-    // Virtual destructor is crucial for base classes with virtual functions
-    virtual ~Transaction() = default;
+        // Version 1 files end before whichever of the recurring rules, budgets
+        // and anomaly model they predate. Missing rules and budgets start
+        // empty; a missing anomaly model is rebuilt from the ledger.
+        if ((version >= 2 || peekSection(in) == "RULES") && !loaded.scheduler.read(in)) return false;
+        if (version >= 3) {
+            if (!(in >> section >> n) || section != "DEFERRED") return false;
+            std::getline(in, line);
+            // Version 5 prefixes each entry with its rule id. Older entries
+            // are matched to a rule by what they book, if one still exists.
+            for (size_t i = 0; i < n; ++i) {
+                RecurringOccurrence occurrence;
+                if (!std::getline(in, line)) return false;
+                if (version >= 5) {
+                    size_t tab = line.find('\t');
+                    if (tab == std::string::npos) return false;
+                    occurrence.ruleId = std::strtoull(line.c_str(), nullptr, 10);
+                    line.erase(0, tab + 1);
+                }
+                if (!(occurrence.transaction = parseTransaction(line))) return false;
+                if (version < 5) occurrence.ruleId = loaded.scheduler.findRule(*occurrence.transaction);
+                loaded.deferredRecurring.push_back(std::move(occurrence));
+            }
+        }
+        if ((version >= 2 || peekSection(in) == "BUDGETS") && !loaded.budgets.read(in)) return false;
 
-    // A pure virtual function to get the type of transaction
-    virtual const char* getType() const = 0;
+        if (version >= 2 || peekSection(in) == "ANOMALY_MODEL") {
+            if (!(in >> section >> n) || section != "ANOMALY_MODEL" || !loaded.anomalies.read(in, n)) return false;
+            loaded.anomalies.refreshAll(loaded.categorySpendSketches);
+        } else {
+            loaded.anomalies = AnomalyDetector::build(loaded.transactions, loaded.categorySpendSketches);
+        }
+        if (version >= 4 && (!(in >> section >> loaded.journaledThrough) || section != "JOURNALED")) return false;
+        if (!peekSection(in).empty()) return false;
 
-    // A single display function, now const-correct
-    void display() const {
-        std::cout << std::left << std::setw(15) << getType()
-                  << std::right << std::setw(10) << amount
-                  << "    " << std::left << description << std::endl;
+        // The open journal is not part of the snapshot; it moves over only
+        // once nothing can fail
+        loaded.journal = std::move(journal);
+        if (loaded.journal) loaded.journal->continueAfter(loaded.journaledThrough);
+        *this = std::move(loaded);
+        return true;
     }
 
-    double getAmount() const { return amount; }
+    // Getter methods for the User class to access transaction data
+    const std::vector<const Transaction*>& getTransactions() const { return transactions; }
+    const std::vector<std::unique_ptr<Investment>>& getInvestments() const { return investments; }
 };
 
-class Income : public Transaction {
+#ifdef FINANCE_HAVE_COROUTINES
+// A lazily started coroutine returning T. Awaiting it runs it to completion
+// and then resumes the awaiting coroutine directly (symmetric transfer).
+template<typename T>
+class Task {
 public:
-    explicit Income(double amt, const std::string& des) : Transaction(amt, des) {}
-    const char* getType() const override { return "Income"; }
-};
+    struct promise_type {
+        T value{};
+        std::coroutine_handle<> continuation;
 
-class Expenditure : public Transaction {
-public:
-    explicit Expenditure(double amt, const std::string& des) : Transaction(amt, des) {}
-    const char* getType() const override { return "Expenditure"; }
-};
+        struct FinalAwaiter {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> done) noexcept {
+                return done.promise().continuation;
+            }
+            void await_resume() const noexcept {}
+        };
 
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        FinalAwaiter final_suspend() const noexcept { return {}; }
+        void return_value(T result) { value = std::move(result); }
+        void unhandled_exception() { std::terminate(); }
+    };
 
-// A base class for all investments
-class Investment {
-protected:
-    double principal;
-    int durationYears;
+private:
+    std::coroutine_handle<promise_type> handle;
 
 public:
-    explicit Investment(double amt, int dur) 
-        : principal(amt), durationYears(dur) {}
-    
-    virtual ~Investment() = default;
-
-    virtual const char* getType() const = 0;
-    virtual double getMaturityAmount() const = 0;
+    explicit Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    Task& operator=(Task&&) = delete;
+    ~Task() {
+        if (handle) handle.destroy();
+    }
 
-    virtual void display() const {
-        std::cout << std::left << std::setw(15) << getType()
-                  << std::right << std::setw(10) << principal
-                  << std::setw(15) << durationYears << " yrs";
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+        handle.promise().continuation = awaiting;
+        return handle;
     }
+    T await_resume() { return std::move(handle.promise().value); }
+};
 
-    double getPrincipal() const { return principal; }
+// A coroutine that starts at once and frees itself when it returns
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() const { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const {}
+        void unhandled_exception() const { std::terminate(); }
+    };
 };
 
-class SIP : public Investment {
+// Single-threaded poll() loop: coroutines suspend on a socket becoming
+// readable or writable and are resumed here when it does
+class EventLoop {
 private:
-    double monthlyInvestment;
-    // AFTER: Using a constant for the interest rate
-    static constexpr double ANNUAL_RATE = 0.096; 
+    struct Waiter {
+        int fd;
+        short events;
+        std::coroutine_handle<> handle;
+    };
+    std::vector<Waiter> waiters;
 
-public:
-    explicit SIP(double principalAmt, int dur, double monthlyAmt) 
-        : Investment(principalAmt, dur), monthlyInvestment(monthlyAmt) {}
+    struct Timer {
+        std::chrono::steady_clock::time_point due;
+        std::coroutine_handle<> handle;
+    };
+    std::vector<Timer> timers;
 
-    const char* getType() const override { return "SIP"; }
+public:
+    void waitFor(int fd, short events, std::coroutine_handle<> handle) { waiters.push_back({fd, events, handle}); }
+    void wakeAt(std::chrono::steady_clock::time_point due, std::coroutine_handle<> handle) { timers.push_back({due, handle}); }
 
-    double getMaturityAmount() const override {
-        double finalAmount = principal * pow(1 + (ANNUAL_RATE / 12), durationYears * 12);
-        // A more standard formula for future value of a series
-        double monthlyContributionFutureValue = monthlyInvestment * ((pow(1 + (ANNUAL_RATE / 12), durationYears * 12) - 1) / (ANNUAL_RATE / 12));
-        return finalAmount + monthlyContributionFutureValue;
+    void run() {
+        std::vector<pollfd> fds;
+        std::vector<std::coroutine_handle<>> ready;
+        while (!waiters.empty() || !timers.empty()) {
+            fds.clear();
+            for (const Waiter& waiter : waiters) fds.push_back({waiter.fd, waiter.events, 0});
+            int timeout = -1;
+            if (!timers.empty()) {
+                auto next = std::min_element(timers.begin(), timers.end(),
+                                             [](const Timer& a, const Timer& b) { return a.due < b.due; })->due;
+                auto wait = std::chrono::ceil<std::chrono::milliseconds>(next - std::chrono::steady_clock::now());
+                timeout = static_cast<int>(std::max<std::chrono::milliseconds::rep>(0, wait.count()));
+            }
+            if (poll(fds.data(), fds.size(), timeout) < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            // Resumed coroutines may queue new waiters, so take the ready ones out first
+            ready.clear();
+            size_t kept = 0;
+            for (size_t i = 0; i < fds.size(); ++i) {
+                if (fds[i].revents) ready.push_back(waiters[i].handle);
+                else waiters[kept++] = waiters[i];
+            }
+            waiters.erase(waiters.begin() + static_cast<std::ptrdiff_t>(kept), waiters.begin() + static_cast<std::ptrdiff_t>(fds.size()));
+            auto now = std::chrono::steady_clock::now();
+            auto firstPending = std::partition(timers.begin(), timers.end(), [now](const Timer& t) { return t.due <= now; });
+            for (auto it = timers.begin(); it != firstPending; ++it) ready.push_back(it->handle);
+            timers.erase(timers.begin(), firstPending);
+            for (std::coroutine_handle<> handle : ready) handle.resume();
+        }
     }
+};
 
-    void display() const override {
-        Investment::display();
-        std::cout << std::setw(25) << " (Monthly: " << monthlyInvestment << ")" << std::endl;
-    }
+struct SocketReady {
+    EventLoop& loop;
+    int fd;
+    short events;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) const { loop.waitFor(fd, events, handle); }
+    void await_resume() const noexcept {}
 };
 
-class FD : public Investment {
-private:
-    // AFTER: Using a constant makes the code cleaner and easier to change
-    static constexpr double ANNUAL_RATE = 0.071;
+struct SleepFor {
+    EventLoop& loop;
+    std::chrono::milliseconds delay;
 
-public:
-    explicit FD(double amt, int dur) : Investment(amt, dur) {}
-    const char* getType() const override { return "Fixed Deposit"; }
-    
-    double getMaturityAmount() const override {
-        return principal * pow((1 + ANNUAL_RATE), durationYears);
-    }
-    
-    void display() const override {
-        Investment::display();
-        std::cout << std::endl;
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) const {
+        loop.wakeAt(std::chrono::steady_clock::now() + delay, handle);
     }
+    void await_resume() const noexcept {}
 };
 
-class FinanceManager {
+// One client's non-blocking socket with line-oriented reads and full writes
+class Connection {
+public:
+    static constexpr size_t MAX_LINE = 4096;
+
 private:
-    // BEFORE: Transaction* transactions[100]; (Fixed size, raw pointers, unsafe)
-    // AFTER: A dynamic vector of unique_ptrs (Safe, modern, flexible)
-    std::vector<std::unique_ptr<Transaction>> transactions;
-    std::vector<std::unique_ptr<Investment>> investments;
+    EventLoop& loop;
+    int fd;
+    std::string buffer;
+    bool overlong = false;
 
 public:
-    // No need for counters like tcount, vector.size() handles it
-    FinanceManager() = default;
-
-    // The vector now owns the Transaction pointer, no memory leaks!
-    void addTransaction(std::unique_ptr<Transaction> t) {
-        transactions.push_back(std::move(t));
-    }
+    Connection(EventLoop& eventLoop, int socket) : loop(eventLoop), fd(socket) {}
+    ~Connection() { close(fd); }
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
 
-    void addInvestment(std::unique_ptr<Investment> i) {
-        investments.push_back(std::move(i));
+    // The next line without its newline; false once the client has gone or
+    // sent a line longer than MAX_LINE (see lineTooLong)
+    Task<bool> readLine(std::string& line) {
+        char chunk[4096];
+        size_t newline;
+        while ((newline = buffer.find('\n')) == std::string::npos) {
+            if (buffer.size() > MAX_LINE) {
+                overlong = true;
+                co_return false;
+            }
+            ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+            if (received > 0) {
+                buffer.append(chunk, static_cast<size_t>(received));
+            } else if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                co_await SocketReady{loop, fd, POLLIN};
+            } else {
+                co_return false;
+            }
+        }
+        if (newline > MAX_LINE) {
+            overlong = true;
+            co_return false;
+        }
+        line = buffer.substr(0, newline);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        buffer.erase(0, newline + 1);
+        co_return true;
     }
 
-    void displayTransactionHistory() const {
-        std::cout << "\n--- Transaction History ---\n";
-        std::cout << std::left << std::setw(15) << "Type"
-                  << std::right << std::setw(10) << "Amount"
-                  << "    " << std::left << "Description" << std::endl;
-        std::cout << std::string(50, '-') << std::endl;
-        for (const auto& t : transactions) {
-            t->display();
+    Task<bool> write(std::string data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = send(fd, data.data() + sent, data.size() - sent, 0);
+            if (n >= 0) {
+                sent += static_cast<size_t>(n);
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                co_await SocketReady{loop, fd, POLLOUT};
+            } else {
+                co_return false;
+            }
         }
+        co_return true;
     }
 
-    void displayInvestmentPortfolio() const {
-        std::cout << "\n--- Investment Portfolio ---\n";
-        std::cout << std::left << std::setw(15) << "Type"
-                  << std::right << std::setw(10) << "Principal"
-                  << std::setw(15) << "Duration"
-                  << "  Details" << std::endl;
-        std::cout << std::string(70, '-') << std::endl;
-        for (const auto& i : investments) {
-            i->display();
-        }
+    bool lineTooLong() const { return overlong; }
+};
+
+using RequestHandler = std::function<std::string(const std::string&)>;
+
+// One client session: read a request line, let the handler parse, validate
+// and apply it, then send its reply, until the client quits or disconnects
+inline DetachedTask serveSession(EventLoop& loop, int fd, const RequestHandler& handler) {
+    Connection connection(loop, fd);
+    std::string line;
+    while (co_await connection.readLine(line)) {
+        std::string reply = handler(line);
+        if (!co_await connection.write(reply + '\n') || reply == "BYE") break;
     }
+    // An unbounded line would grow the buffer without limit, so the client is dropped
+    if (connection.lineTooLong()) co_await connection.write("ERR line too long\n");
+}
 
-    void displayInvestmentProjections() const {
-        std::cout << "\n--- Investment Maturity Projections ---\n";
-        for (size_t i = 0; i < investments.size(); ++i) {
-            const auto& inv = investments[i];
-            std::cout << "Portfolio Item " << i + 1 << " (" << inv->getType() << "):\n";
-            std::cout << "  Matures to: " << std::fixed << std::setprecision(2) << inv->getMaturityAmount() << " INR" << std::endl;
+inline DetachedTask acceptClients(EventLoop& loop, int listener, const RequestHandler& handler) {
+    constexpr std::chrono::milliseconds ACCEPT_BACKOFF{1000};
+    while (true) {
+        co_await SocketReady{loop, listener, POLLIN};
+        int client;
+        while ((client = accept(listener, nullptr, nullptr)) >= 0) {
+            fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+            serveSession(loop, client, handler);
+        }
+        // Out of descriptors or memory: the pending connection keeps the
+        // listener readable, so wait for sessions to close rather than spin
+        if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+            std::cout << "Warning: Could not accept a client (" << std::strerror(errno) << "); retrying in "
+                      << ACCEPT_BACKOFF.count() / 1000 << " s." << std::endl;
+            co_await SleepFor{loop, ACCEPT_BACKOFF};
         }
     }
-    
-    // Getter methods for the User class to access transaction data
-    const std::vector<std::unique_ptr<Transaction>>& getTransactions() const { return transactions; }
-    const std::vector<std::unique_ptr<Investment>>& getInvestments() const { return investments; }
-};
+}
+#endif
 
 class User {
 private:
@@ -181,11 +4858,41 @@ private:
     
     // AFTER: Use a constant for the minimum balance
     static constexpr double MINIMUM_BALANCE = 1000.0;
+    static constexpr const char* DATA_FILE = "finance_data.txt";
+    static constexpr const char* JOURNAL_FILE = "finance_journal.txt";
+    static constexpr const char* TRACE_FILE = "trace.json";
+
+    static constexpr const char* NAV_DIRECTORY = "nav";
+    NavStore navStore{NAV_DIRECTORY};
+
+    // Optional trailing-window spend limits (7/30/90 days); 0 means no limit
+    std::array<double, RollingWindow::WINDOW_COUNT> rollingLimits{};
+
+    // Set while DATA_FILE exists but could not be loaded, so a save does not
+    // replace it with this session's partial state
+    bool unreadSnapshot = false;
 
     // Helper functions for user input
     void recordIncome();
     void recordExpenditure();
     void makeInvestment();
+    void showReports();
+    void saveData() const;
+    bool loadData();
+    bool restoreState();
+    void replayJournal();
+    void showSettings();
+    void importTransactions();
+    void displayOperationLatency() const;
+#ifdef FINANCE_TRACING
+    void writeTrace() const;
+#endif
+    SpendingGuard spendingGuard() const;
+    void applyRecurring();
+    void addRecurringRule();
+    void addBudget();
+    void reportBudgetAlerts();
+    void reportJournalFailures();
 
     // A robust function to get numeric input from the user
     template<typename T>
@@ -213,14 +4920,54 @@ private:
         return value;
     }
 
+    // Splits "a, b ,c" into trimmed, non-empty items
+    static std::vector<std::string> splitList(const std::string& text) {
+        std::vector<std::string> items;
+        std::istringstream stream(text);
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            size_t first = item.find_first_not_of(" \t");
+            if (first == std::string::npos) continue;
+            size_t last = item.find_last_not_of(" \t");
+            items.push_back(item.substr(first, last - first + 1));
+        }
+        return items;
+    }
+
+    // Categories default to "General" when left blank
+    std::string getCategoryInput() {
+        std::string category = getStringInput("Enter category (e.g., Food, blank for General): ");
+        return category.empty() ? "General" : category;
+    }
+
 public:
-    explicit User(double initialBalance) : balance(initialBalance) {}
+    explicit User(double initialBalance) : balance(initialBalance) {
+        if (!manager.openJournal(JOURNAL_FILE)) {
+            std::cout << "Warning: Could not open " << JOURNAL_FILE << "; transactions are kept only until you save.\n";
+        }
+    }
+
+#ifdef FINANCE_HAVE_COROUTINES
+    // Server mode: answers the line protocol on `port` until the process
+    // ends; false if the saved state or the port could not be opened
+    bool serve(uint16_t port);
+    std::string handleRequest(const std::string& line);
+#endif
 
     void run() {
+        if (!restoreState()) {
+            std::cout << "Warning: Starting without the saved data; saving is disabled until Load Data succeeds.\n";
+        }
         int choice = -1;
         while (choice != 0) {
+            applyRecurring();
+            reportJournalFailures();
             std::cout << "\n========= FINANCE MENU =========\n";
             std::cout << "Current Balance: " << std::fixed << std::setprecision(2) << balance << " INR\n";
+            if (manager.getDeferredRecurringCount() > 0) {
+                std::cout << "Deferred recurring: " << manager.getDeferredRecurringCount() << " expense(s), "
+                          << manager.getDeferredRecurringTotal() << " INR owed (Settings > View Recurring Rules)\n";
+            }
             std::cout << "--------------------------------\n";
             std::cout << "1. Record Income\n";
             std::cout << "2. Record Expenditure\n";
@@ -228,6 +4975,10 @@ public:
             std::cout << "4. View Transaction History\n";
             std::cout << "5. View Investment Portfolio\n";
             std::cout << "6. View Investment Projections\n";
+            std::cout << "7. Reports & Analytics\n";
+            std::cout << "8. Save Data\n";
+            std::cout << "9. Load Data\n";
+            std::cout << "10. Settings\n";
             std::cout << "0. Exit\n";
             
             choice = getNumericInput<int>("Enter choice: ");
@@ -239,7 +4990,16 @@ public:
                 case 4: manager.displayTransactionHistory(); break;
                 case 5: manager.displayInvestmentPortfolio(); break;
                 case 6: manager.displayInvestmentProjections(); break;
-                case 0: std::cout << "Exiting. Goodbye!\n"; break;
+                case 7: showReports(); break;
+                case 8: saveData(); break;
+                case 9: loadData(); break;
+                case 10: showSettings(); break;
+                case 0:
+#ifdef FINANCE_TRACING
+                    writeTrace();
+#endif
+                    std::cout << "Exiting. Goodbye!\n";
+                    break;
                 default: std::cout << "Invalid option. Please try again.\n"; break;
             }
         }
@@ -250,23 +5010,40 @@ public:
 void User::recordIncome() {
     double amt = getNumericInput<double>("Enter income amount: ");
     std::string desc = getStringInput("Enter description (e.g., Salary): ");
-    
+    std::string category = getCategoryInput();
+
+    OperationScope scope(Operation::RecordIncome);
     balance += amt;
-    manager.addTransaction(std::make_unique<Income>(amt, desc));
+    manager.addTransaction(std::make_unique<Income>(amt, desc, category));
     std::cout << "Income recorded successfully.\n";
 }
 
 void User::recordExpenditure() {
     double amt = getNumericInput<double>("Enter expenditure amount: ");
-    if (balance - amt < MINIMUM_BALANCE) {
-        std::cout << "Error: Transaction declined. Balance cannot fall below " << MINIMUM_BALANCE << " INR.\n";
+    SpendingGuard guard = spendingGuard();
+    SpendingGuard::Result check = guard.checkLimits(amt, std::time(nullptr));
+    if (check.verdict != SpendingGuard::Verdict::Accepted) {
+        std::cout << "Error: Transaction declined: " << check.reason << ".\n";
         return;
     }
     std::string desc = getStringInput("Enter description (e.g., Groceries): ");
-    
+    std::string category = getCategoryInput();
+
+    check = guard.check(amt, category, std::time(nullptr));
+    if (check.verdict == SpendingGuard::Verdict::Unusual) {
+        std::cout << "Warning: " << check.reason << ".\n";
+        std::string answer = getStringInput("Record it anyway? (y/n): ");
+        if (answer != "y" && answer != "Y") {
+            std::cout << "Expenditure not recorded.\n";
+            return;
+        }
+    }
+
+    OperationScope scope(Operation::RecordExpenditure);
     balance -= amt;
-    manager.addTransaction(std::make_unique<Expenditure>(amt, desc));
+    manager.addTransaction(std::make_unique<Expenditure>(amt, desc, category));
     std::cout << "Expenditure recorded successfully.\n";
+    reportBudgetAlerts();
 }
 
 void User::makeInvestment() {
@@ -287,8 +5064,23 @@ void User::makeInvestment() {
 
     switch (choice) {
         case 1: {
-            double monthly = getNumericInput<double>("Enter monthly investment amount: ");
-            manager.addInvestment(std::make_unique<SIP>(principal, duration, monthly));
+            double monthly = getNumericInput<double>("Enter monthly investment amount (0 to plan from a goal): ");
+            if (monthly <= 0.0) {
+                double target = getNumericInput<double>("Enter target amount to reach: ");
+                monthly = GoalSolver::requiredMonthly({SavingsGoal{target, duration, principal}}).front();
+                if (!(monthly >= 0.0)) {
+                    std::cout << "Error: Cannot plan a goal with that duration.\n";
+                    return;
+                }
+                std::cout << "Required monthly investment: " << std::fixed << std::setprecision(2) << monthly << " INR\n";
+            }
+            std::string fund = getStringInput("Enter fund code for NAV tracking (blank for none): ");
+            fund.erase(std::remove_if(fund.begin(), fund.end(), [](unsigned char c) { return std::isspace(c); }), fund.end());
+            if (!fund.empty() && !isValidFundCode(fund)) {
+                std::cout << "Error: Fund codes may only contain letters, digits, '_' and '-'.\n";
+                return;
+            }
+            manager.addInvestment(std::make_unique<SIP>(principal, duration, monthly, std::time(nullptr), fund));
             balance -= principal;
             std::cout << "SIP investment made successfully.\n";
             break;
@@ -306,12 +5098,564 @@ void User::makeInvestment() {
     }
 }
 
+void User::showReports() {
+    std::cout << "\n--- Reports & Analytics ---\n";
+    std::cout << "1. Top Expenditures\n";
+    std::cout << "2. Top Payees\n";
+    std::cout << "3. Spending Distribution (Median / p95)\n";
+    std::cout << "4. Monthly Statement\n";
+    std::cout << "5. Rolling Spend (7/30/90 days)\n";
+    std::cout << "6. Category Filter Totals\n";
+    std::cout << "7. Transactions in Amount Range\n";
+    std::cout << "8. Run Query\n";
+    std::cout << "9. Portfolio XIRR\n";
+    std::cout << "10. What-if Scenario Grid\n";
+    std::cout << "11. SIP Goal Planner\n";
+    std::cout << "12. Mark-to-Market SIP Valuation\n";
+    std::cout << "13. Balance Forecast (24 months)\n";
+    std::cout << "14. Journal Statistics\n";
+    std::cout << "15. Operation Latency\n";
+#ifdef FINANCE_TRACING
+    std::cout << "16. Write Trace (" << TRACE_FILE << ")\n";
+#endif
+    std::cout << "0. Back to Main Menu\n";
+    int choice = getNumericInput<int>("Choose report: ");
+
+    switch (choice) {
+        case 0: return;
+        case 1: {
+            int k = getNumericInput<int>("How many expenditures to show: ");
+            std::string category = getStringInput("Enter category (blank for all): ");
+            manager.displayTopExpenditures(k > 0 ? static_cast<size_t>(k) : 0, category);
+            break;
+        }
+        case 2: {
+            int k = getNumericInput<int>("How many payees to show: ");
+            manager.displayTopPayees(k > 0 ? static_cast<size_t>(k) : 0);
+            break;
+        }
+        case 3: manager.displaySpendingDistribution(); break;
+        case 4: {
+            int months = getNumericInput<int>("How many recent months (0 for all): ");
+            manager.displayMonthlyStatement(months > 0 ? static_cast<size_t>(months) : 0);
+            break;
+        }
+        case 5: manager.displayRollingSpend(); break;
+        case 6: {
+            int kindChoice = getNumericInput<int>("Kind (1 Income, 2 Expenditure, 0 Both): ");
+            std::vector<std::string> include = splitList(getStringInput("Include categories, comma-separated (blank for all): "));
+            std::vector<std::string> exclude = splitList(getStringInput("Exclude categories, comma-separated (blank for none): "));
+            TransactionKind kind = kindChoice == 1 ? TransactionKind::Income : TransactionKind::Expenditure;
+            RollupCell totals = manager.filterTotals(kindChoice == 1 || kindChoice == 2 ? &kind : nullptr, include, exclude);
+            std::cout << "Matching transactions: " << totals.count << ", total: "
+                      << std::fixed << std::setprecision(2) << totals.total << " INR\n";
+            break;
+        }
+        case 7: {
+            double lo = getNumericInput<double>("Enter minimum amount: ");
+            double hi = getNumericInput<double>("Enter maximum amount (0 for no maximum): ");
+            manager.displayAmountRange(lo, hi > 0.0 ? hi : std::numeric_limits<double>::max());
+            break;
+        }
+        case 8: {
+            std::cout << "Syntax: [list|count|sum|avg|min|max] [kind=...] [category=...] [amount>=N] [date<YYYY-MM-DD]\n"
+                      << "        [desc~text] [order amount|date asc|desc] [limit N]\n";
+            std::string text = getStringInput("Enter query: ");
+            Query query;
+            std::string error;
+            if (!parseQuery(text, query, error)) {
+                std::cout << "Error: Invalid query: " << error << ".\n";
+                break;
+            }
+            manager.displayQueryResult(manager.runCachedQuery(query));
+            const QueryCache& cache = manager.getQueryCache();
+            std::cout << "Query cache: " << cache.size() << " entries, " << cache.getHits() << " hits, "
+                      << cache.getMisses() << " misses\n";
+            break;
+        }
+        case 9: manager.displayPortfolioXirr(navStore); break;
+        case 10: {
+            ScenarioGrid grid;
+            double minRate = getNumericInput<double>("Enter lowest annual rate %: ");
+            double maxRate = getNumericInput<double>("Enter highest annual rate %: ");
+            int rateSteps = std::max(1, getNumericInput<int>("Enter number of rates: "));
+            int minYears = std::max(1, getNumericInput<int>("Enter shortest duration in years: "));
+            int maxYears = std::max(minYears, getNumericInput<int>("Enter longest duration in years: "));
+            for (int r = 0; r < rateSteps; ++r) {
+                double fraction = rateSteps == 1 ? 0.0 : static_cast<double>(r) / (rateSteps - 1);
+                grid.rates.push_back((minRate + (maxRate - minRate) * fraction) / 100.0);
+            }
+            for (int years = minYears; years <= maxYears; ++years) grid.durations.push_back(years);
+            manager.displayScenarioGrid(grid);
+            break;
+        }
+        case 11: {
+            SavingsGoal goal{getNumericInput<double>("Enter target amount: "),
+                             std::max(1, getNumericInput<int>("Enter years to reach it: ")),
+                             getNumericInput<double>("Enter up-front principal: ")};
+            double needed = GoalSolver::requiredMonthly({goal}).front();
+            std::cout << "Monthly SIP needed at " << SIP::getAnnualRate() * 100.0 << "%: "
+                      << std::fixed << std::setprecision(2) << needed << " INR\n";
+            double budget = getNumericInput<double>("Enter the monthly amount you can afford (0 to skip): ");
+            if (budget > 0.0) {
+                double rate = GoalSolver::requiredRate({goal}, {budget}).front();
+                if (std::isnan(rate)) std::cout << "That goal is out of reach even at 100% a year.\n";
+                else std::cout << "Annual return needed: " << std::fixed << std::setprecision(2) << rate * 100.0 << "%\n";
+            }
+            break;
+        }
+        case 12: manager.displayMarketValuation(navStore); break;
+        case 13: manager.displayForecast(balance, MINIMUM_BALANCE); break;
+        case 14: manager.displayJournalStats(); break;
+        case 15: displayOperationLatency(); break;
+#ifdef FINANCE_TRACING
+        case 16: writeTrace(); break;
+#endif
+        default: std::cout << "Invalid report option.\n"; break;
+    }
+}
+
+void User::saveData() const {
+    OperationScope scope(Operation::SaveData);
+    if (unreadSnapshot) {
+        std::cout << "Error: " << DATA_FILE << " has not been loaded; saving now would replace it. Use Load Data first.\n";
+        return;
+    }
+    if (manager.hasUnreplayedJournal()) {
+        std::cout << "Error: " << JOURNAL_FILE << " holds transactions this session has not loaded. Use Load Data first.\n";
+        return;
+    }
+    // Written beside the old snapshot and swapped in once durable; only then
+    // is the journal cleared
+    const std::string tmpPath = std::string(DATA_FILE) + ".tmp";
+    std::ofstream out(tmpPath);
+    if (!out) {
+        std::cout << "Error: Could not open " << tmpPath << " for writing.\n";
+        return;
+    }
+    out << "FORMAT " << FinanceManager::SNAPSHOT_VERSION << '\n';
+    out << "BALANCE " << std::setprecision(17) << balance << '\n';
+    out << "ROLLING_LIMITS";
+    for (double limit : rollingLimits) out << ' ' << limit;
+    out << '\n';
+    manager.saveSnapshot(out);
+    out.close();
+    if (!out || !replaceFileDurably(tmpPath, DATA_FILE)) {
+        std::cout << "Error: Failed while writing " << DATA_FILE << "; the previous save is unchanged.\n";
+        std::remove(tmpPath.c_str());
+        return;
+    }
+    // Everything journaled so far is now in the snapshot
+    if (!manager.truncateJournal()) std::cout << "Warning: Could not clear " << JOURNAL_FILE << ".\n";
+    std::cout << "Data saved to " << DATA_FILE << ".\n";
+}
+
+bool User::loadData() {
+    OperationScope scope(Operation::LoadData);
+    std::ifstream in(DATA_FILE);
+    if (!in) {
+        std::cout << "Error: Could not open " << DATA_FILE << ".\n";
+        return false;
+    }
+    std::string tag, limitsTag;
+    int version = 1;
+    bool valid = static_cast<bool>(in >> tag);
+    if (valid && tag == "FORMAT") valid = (in >> version) && (in >> tag);
+    if (valid && version > FinanceManager::SNAPSHOT_VERSION) {
+        std::cout << "Error: " << DATA_FILE << " was written by a newer version (format " << version << ").\n";
+        return false;
+    }
+    double savedBalance = 0.0;
+    std::array<double, RollingWindow::WINDOW_COUNT> savedLimits{};
+    valid = valid && tag == "BALANCE" && (in >> savedBalance) && (in >> limitsTag) && limitsTag == "ROLLING_LIMITS";
+    for (size_t w = 0; valid && w < savedLimits.size(); ++w) valid = static_cast<bool>(in >> savedLimits[w]);
+    if (!valid || !manager.loadSnapshot(in, version)) {
+        std::cout << "Error: " << DATA_FILE << " is not a valid snapshot.\n";
+        return false;
+    }
+    balance = savedBalance;
+    rollingLimits = savedLimits;
+    unreadSnapshot = false;
+    std::cout << "Data loaded from " << DATA_FILE << ".\n";
+    replayJournal();
+    return true;
+}
+
+// Starts from the saved state plus everything journaled since; with no
+// snapshot yet, the journal alone
+bool User::restoreState() {
+    if (!std::filesystem::exists(DATA_FILE)) {
+        replayJournal();
+        return true;
+    }
+    unreadSnapshot = !loadData();
+    return !unreadSnapshot;
+}
+
+// Applies transactions journaled since the snapshot to the current state
+void User::replayJournal() {
+    std::vector<const Transaction*> replayed = manager.replayJournal();
+    for (const Transaction* t : replayed) {
+        balance += t->getKind() == TransactionKind::Income ? t->getAmount() : -t->getAmount();
+    }
+    if (!replayed.empty()) std::cout << "Replayed " << replayed.size() << " transaction(s) from " << JOURNAL_FILE << ".\n";
+}
+
+// Bulk-loads a CSV file; expenditures pass the same checks as menu entries
+void User::importTransactions() {
+    std::string path = getStringInput("Enter CSV path (lines of YYYY-MM-DD,Income|Expenditure,amount,category,description): ");
+    OperationScope scope(Operation::ImportCsv);
+    // The manager updates its model as batches land, so the validator scores
+    // rows against a copy taken before the import
+    AnomalyDetector model = manager.getAnomalyModel();
+    SpendingGuard guard(balance, MINIMUM_BALANCE, rollingLimits, manager.getRollingSpend(), model);
+    ImportResult result;
+    bool ok = ImportPipeline::run(path, guard,
+        [this](ImportPipeline::Batch batch) { manager.importBatch(std::move(batch)); }, result);
+    if (!ok) {
+        std::cout << "Error: Could not read " << path << ".\n";
+        return;
+    }
+    balance = result.balance;
+    std::cout << "Imported " << result.imported << " transaction(s) in " << std::fixed << std::setprecision(2)
+              << result.seconds << " s.\n";
+    if (result.rejected > 0) {
+        std::cout << "Skipped " << result.rejected << " expenditure(s) that would take the balance below "
+                  << MINIMUM_BALANCE << " INR.\n";
+    }
+    if (result.overLimit > 0) {
+        std::cout << "Skipped " << result.overLimit << " expenditure(s) that would exceed a rolling spending limit.\n";
+    }
+    if (result.unusual > 0) {
+        std::cout << "Imported " << result.unusual << " expenditure(s) that are unusual for their category; review them.\n";
+    }
+    if (result.invalidDates > 0) {
+        std::cout << "Skipped " << result.invalidDates << " row(s) dated on days that do not exist (e.g. 2026-02-31).\n";
+    }
+    if (result.malformed > 0) std::cout << "Skipped " << result.malformed << " malformed line(s).\n";
+    reportBudgetAlerts();
+}
+
+void User::displayOperationLatency() const {
+    std::vector<LatencyHistogram::Counts> latencies = LatencyRegistry::shared().collect();
+    std::cout << "\n--- Operation Latency (microseconds) ---\n";
+    std::cout << std::left << std::setw(24) << "Operation" << std::right << std::setw(10) << "Count"
+              << std::setw(12) << "p50" << std::setw(12) << "p99" << std::setw(12) << "p99.9" << std::setw(12) << "Max" << std::endl;
+    std::cout << std::string(82, '-') << std::endl;
+    for (size_t op = 0; op < OPERATION_COUNT; ++op) {
+        const LatencyHistogram::Counts& counts = latencies[op];
+        if (counts.count == 0) continue;
+        std::cout << std::left << std::setw(24) << operationName(static_cast<Operation>(op))
+                  << std::right << std::setw(10) << counts.count << std::fixed << std::setprecision(1)
+                  << std::setw(12) << counts.percentile(0.5) / 1000.0 << std::setw(12) << counts.percentile(0.99) / 1000.0
+                  << std::setw(12) << counts.percentile(0.999) / 1000.0 << std::setw(12) << static_cast<double>(counts.max) / 1000.0
+                  << std::endl;
+    }
+}
+
+#ifdef FINANCE_TRACING
+void User::writeTrace() const {
+    if (TraceRecorder::shared().writeJson(TRACE_FILE)) std::cout << "Trace written to " << TRACE_FILE << ".\n";
+    else std::cout << "Error: Could not write " << TRACE_FILE << ".\n";
+}
+#endif
+
+// Checks against the current balance, rolling limits and anomaly model
+SpendingGuard User::spendingGuard() const {
+    return SpendingGuard(balance, MINIMUM_BALANCE, rollingLimits, manager.getRollingSpend(), manager.getAnomalyModel());
+}
+
+#ifdef FINANCE_HAVE_COROUTINES
+// Line protocol for server mode. Requests run one at a time on the event
+// loop's thread, so they see and update the balance like menu actions do.
+std::string User::handleRequest(const std::string& line) {
+    OperationScope scope(Operation::ServerRequest);
+    applyRecurring();         // Logged to the server's console, as are
+    reportJournalFailures();  // journal failures
+    std::istringstream in(line);
+    std::string command;
+    in >> command;
+    // CONFIRM EXPENSE records an expenditure the anomaly check flagged
+    bool confirmed = command == "CONFIRM";
+    if (confirmed && !(in >> command && command == "EXPENSE")) return "ERR usage: CONFIRM EXPENSE <amount> <category> [description]";
+    std::ostringstream reply;
+    reply << std::fixed << std::setprecision(2);
+
+    if (command == "BALANCE") {
+        reply << "OK " << balance;
+    } else if (command == "INCOME" || command == "EXPENSE") {
+        double amount = 0.0;
+        std::string category, description;
+        if (!(in >> amount >> category) || !(amount > 0.0)) return "ERR usage: " + command + " <amount> <category> [description]";
+        std::getline(in >> std::ws, description);
+        if (command == "EXPENSE") {
+            SpendingGuard::Result check = spendingGuard().check(amount, category, std::time(nullptr));
+            if (check.verdict == SpendingGuard::Verdict::Unusual && !confirmed) {
+                return "ERR " + check.reason + "; send CONFIRM EXPENSE to record it anyway";
+            }
+            if (check.verdict != SpendingGuard::Verdict::Accepted && check.verdict != SpendingGuard::Verdict::Unusual) {
+                return "ERR " + check.reason;
+            }
+            balance -= amount;
+            manager.addTransaction(std::make_unique<Expenditure>(amount, description, category));
+        } else {
+            balance += amount;
+            manager.addTransaction(std::make_unique<Income>(amount, description, category));
+        }
+        reply << "OK " << balance;
+        for (const BudgetAlert& alert : manager.takeBudgetAlerts()) {
+            reply << " ALERT " << (alert.category.empty() ? "total" : alert.category) << ' '
+                  << std::setprecision(0) << alert.threshold * 100.0 << '%' << std::setprecision(2);
+        }
+    } else if (command == "STATS") {
+        std::vector<LatencyHistogram::Counts> latencies = LatencyRegistry::shared().collect();
+        reply << "OK" << std::setprecision(1);
+        for (size_t op = 0; op < OPERATION_COUNT; ++op) {
+            const LatencyHistogram::Counts& counts = latencies[op];
+            if (counts.count == 0) continue;
+            reply << ' ' << operationName(static_cast<Operation>(op)) << " n=" << counts.count
+                  << " p50=" << counts.percentile(0.5) / 1000.0 << "us p99=" << counts.percentile(0.99) / 1000.0
+                  << "us p999=" << counts.percentile(0.999) / 1000.0 << "us;";
+        }
+#ifdef FINANCE_TRACING
+    } else if (command == "TRACE") {
+        if (!TraceRecorder::shared().writeJson(TRACE_FILE)) return "ERR could not write trace";
+        reply << "OK " << TRACE_FILE;
+#endif
+    } else if (command == "QUIT") {
+        return "BYE";
+    } else {
+        return "ERR unknown command (BALANCE, INCOME, EXPENSE, CONFIRM EXPENSE, STATS, QUIT)";
+    }
+    return reply.str();
+}
+
+bool User::serve(uint16_t port) {
+    // Recurring entries that came due while nothing was running are booked
+    // before the first client connects
+    if (!restoreState()) return false;
+    applyRecurring();
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (listener < 0 || setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0
+        || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+        std::cout << "Error: Could not listen on port " << port << ".\n";
+        if (listener >= 0) close(listener);
+        return false;
+    }
+    fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+    std::signal(SIGPIPE, SIG_IGN);  // A vanished client must not end the server
+
+    std::cout << "Serving on port " << port << "." << std::endl;
+    EventLoop loop;
+    RequestHandler handler = [this](const std::string& line) { return handleRequest(line); };
+    acceptClients(loop, listener, handler);
+    loop.run();
+    close(listener);
+    return true;
+}
+#endif
+
+void User::showSettings() {
+    std::cout << "\n--- Settings ---\n";
+    std::cout << "1. Set Rolling Spend Limits\n";
+    std::cout << "2. Import Fund NAV History (CSV)\n";
+    std::cout << "3. Add Recurring Income/Expenditure\n";
+    std::cout << "4. View Recurring Rules\n";
+    std::cout << "5. Remove Recurring Rule\n";
+    std::cout << "6. Add Budget\n";
+    std::cout << "7. View Budgets\n";
+    std::cout << "8. Remove Budget\n";
+    std::cout << "9. Import Transactions (CSV)\n";
+    std::cout << "0. Back to Main Menu\n";
+    int choice = getNumericInput<int>("Choose setting: ");
+
+    switch (choice) {
+        case 0: return;
+        case 1: {
+            for (size_t w = 0; w < rollingLimits.size(); ++w) {
+                double limit = getNumericInput<double>("Enter " + std::to_string(RollingWindow::WINDOW_DAYS[w])
+                                                       + "-day spend limit (0 for none): ");
+                rollingLimits[w] = limit > 0.0 ? limit : 0.0;
+            }
+            std::cout << "Rolling spend limits updated.\n";
+            break;
+        }
+        case 2: {
+            std::string fund = getStringInput("Enter fund code: ");
+            std::string path = getStringInput("Enter CSV path (lines of YYYY-MM-DD,nav): ");
+            std::string error;
+            if (!isValidFundCode(fund)) {
+                std::cout << "Error: Fund codes may only contain letters, digits, '_' and '-'.\n";
+            } else if (!navStore.importCsv(path, fund, error)) {
+                std::cout << "Error: NAV import failed: " << error << ".\n";
+            } else {
+                std::cout << "NAV history for " << fund << " imported.\n";
+            }
+            break;
+        }
+        case 3: addRecurringRule(); break;
+        case 4: manager.displayRecurringRules(); break;
+        case 5: {
+            int id = getNumericInput<int>("Enter rule id to remove: ");
+            std::cout << (id > 0 && manager.removeRecurringRule(static_cast<uint64_t>(id))
+                          ? "Recurring rule removed.\n" : "Error: No such recurring rule.\n");
+            break;
+        }
+        case 6: addBudget(); break;
+        case 7: manager.displayBudgets(); break;
+        case 8: {
+            int id = getNumericInput<int>("Enter budget id to remove: ");
+            std::cout << (id > 0 && manager.removeBudget(static_cast<uint64_t>(id))
+                          ? "Budget removed.\n" : "Error: No such budget.\n");
+            break;
+        }
+        case 9: importTransactions(); break;
+        default: std::cout << "Invalid settings option.\n"; break;
+    }
+}
+
+// Applies every recurring entry that has come due since the last check as one
+// batch. Expenditures that would break the balance rules are skipped.
+// Expenditures go through the same checks as manual ones. One that fails
+// is deferred and retried on later calls instead of being dropped; unusual
+// amounts are noted but applied, since the rule itself was confirmed.
+void User::applyRecurring() {
+    // Deferred and newly due occurrences, oldest first; the flag marks retries
+    std::vector<std::pair<RecurringOccurrence, bool>> pending;
+    for (auto& occurrence : manager.takeDeferredRecurring()) pending.emplace_back(std::move(occurrence), true);
+    for (auto& occurrence : manager.collectDueRecurring()) pending.emplace_back(std::move(occurrence), false);
+    if (pending.empty()) return;
+    std::stable_sort(pending.begin(), pending.end(), [](const auto& a, const auto& b) {
+        return a.first.transaction->getTimestamp() < b.first.transaction->getTimestamp();
+    });
+    // An occurrence that still cannot be paid once a later one of its rule is
+    // due is skipped rather than deferred again, so each rule owes at most one
+    std::map<uint64_t, size_t> latest;
+    for (size_t i = 0; i < pending.size(); ++i) latest[pending[i].first.ruleId] = i;
+
+    SpendingGuard guard = spendingGuard();
+    std::vector<std::unique_ptr<Transaction>> accepted;
+    std::vector<RecurringOccurrence> deferred;
+    for (size_t i = 0; i < pending.size(); ++i) {
+        RecurringOccurrence& occurrence = pending[i].first;
+        std::unique_ptr<Transaction>& t = occurrence.transaction;
+        if (t->getKind() == TransactionKind::Expenditure) {
+            SpendingGuard::Result check = guard.check(t->getAmount(), t->getCategory(), t->getTimestamp());
+            if (check.verdict == SpendingGuard::Verdict::BelowMinimum || check.verdict == SpendingGuard::Verdict::OverLimit) {
+                if (occurrence.ruleId == 0 || latest[occurrence.ruleId] != i) {
+                    std::cout << "Skipped recurring " << t->getDescription() << " due " << formatDate(t->getTimestamp())
+                              << ": " << check.reason << ", and "
+                              << (occurrence.ruleId == 0 ? "its rule no longer exists" : "a later occurrence is now due")
+                              << ".\n";
+                    continue;
+                }
+                if (!pending[i].second) {
+                    std::cout << "Deferred recurring " << t->getDescription() << " due " << formatDate(t->getTimestamp())
+                              << ": " << check.reason << ". It will be retried.\n";
+                }
+                deferred.push_back(std::move(occurrence));
+                continue;
+            }
+            if (check.verdict == SpendingGuard::Verdict::Unusual) {
+                std::cout << "Note: recurring " << t->getDescription() << ": " << check.reason << ".\n";
+            }
+            balance -= t->getAmount();
+        } else {
+            balance += t->getAmount();
+        }
+        guard.accept(*t);
+        accepted.push_back(std::move(t));
+    }
+    manager.deferRecurring(std::move(deferred));
+    if (accepted.empty()) return;
+    std::cout << "Applied " << accepted.size() << " recurring transaction(s).\n";
+    manager.addTransactions(std::move(accepted));
+    reportBudgetAlerts();
+}
+
+void User::addRecurringRule() {
+    RecurringRule rule;
+    int kind = getNumericInput<int>("Type (1 Income, 2 Expenditure): ");
+    if (kind != 1 && kind != 2) {
+        std::cout << "Invalid type.\n";
+        return;
+    }
+    rule.kind = kind == 1 ? TransactionKind::Income : TransactionKind::Expenditure;
+    rule.amount = getNumericInput<double>("Enter amount: ");
+    rule.description = getStringInput("Enter description (e.g., Rent): ");
+    rule.category = getCategoryInput();
+    int unit = getNumericInput<int>("Repeat by (1 Days, 2 Months): ");
+    rule.unit = unit == 1 ? RecurringRule::Unit::Days : RecurringRule::Unit::Months;
+    rule.interval = std::max(1, getNumericInput<int>("Repeat every how many? "));
+    std::string first = getStringInput("First date YYYY-MM-DD (blank for today): ");
+    rule.nextDue = std::time(nullptr);
+    if (!first.empty() && !parseDate(first, rule.nextDue)) {
+        std::cout << "Error: Invalid date.\n";
+        return;
+    }
+    uint64_t id = manager.addRecurringRule(std::move(rule));
+    std::cout << "Recurring rule " << id << " added.\n";
+}
+
+void User::addBudget() {
+    Budget budget;
+    budget.category = getStringInput("Enter category (blank for all spending): ");
+    int period = getNumericInput<int>("Period (1 Weekly, 2 Monthly): ");
+    budget.period = period == 1 ? Budget::Period::Weekly : Budget::Period::Monthly;
+    budget.limit = getNumericInput<double>("Enter budget limit: ");
+    if (budget.limit <= 0.0) {
+        std::cout << "Error: Budget limit must be positive.\n";
+        return;
+    }
+    uint64_t id = manager.addBudget(std::move(budget));
+    const Budget& added = manager.getBudgets().at(id);
+    std::cout << "Budget " << id << " added (" << std::fixed << std::setprecision(2) << added.spent << " of "
+              << added.limit << " INR already spent this period).\n";
+    reportBudgetAlerts();
+}
+
+void User::reportJournalFailures() {
+    uint64_t failed = manager.takeJournalFailures();
+    if (failed == 0) return;
+    std::cout << "Warning: " << failed << " transaction(s) could not be written to " << JOURNAL_FILE
+              << "; save now to keep them.\n";
+}
+
+void User::reportBudgetAlerts() {
+    for (const BudgetAlert& alert : manager.takeBudgetAlerts()) {
+        std::cout << "Budget alert: " << (alert.category.empty() ? "total spending" : alert.category)
+                  << " has reached " << std::fixed << std::setprecision(0) << alert.threshold * 100.0
+                  << "% of its limit (" << std::setprecision(2) << alert.spent << " of " << alert.limit << " INR).\n";
+    }
+}
+
 } // end namespace Finance
 
-int main() {
+int main(int argc, char* argv[]) {
     std::cout << "--- Welcome to your Personal Finance Management System! ---\n";
     const double initialBalance = 5000.0;
     Finance::User user(initialBalance);
+    if (argc == 3 && std::string(argv[1]) == "--server") {
+#ifdef FINANCE_HAVE_COROUTINES
+        char* end = nullptr;
+        errno = 0;
+        long port = std::strtol(argv[2], &end, 10);
+        if (end == argv[2] || *end != '\0' || errno != 0 || port < 1 || port > 65535) {
+            std::cout << "Error: Port must be a number from 1 to 65535.\n";
+            return 1;
+        }
+        return user.serve(static_cast<uint16_t>(port)) ? 0 : 1;
+#else
+        std::cout << "Error: Server mode needs a C++20 build on a POSIX system.\n";
+        return 1;
+#endif
+    }
     user.run();
 
     return 0;